@@ -92,20 +92,24 @@ void pc_Callback(const sensor_msgs::PointCloud2ConstPtr msg)
         PointA centroid1, centroid2, centroid3, centroid4;
 
         printf("Point1\n");
-        neighbors_with_radius_Search(cloud1, p1, searchPoints1, searchPoint1);
-        K_nearest_neighbor_search(K, cloud1, searchPoint1, centroid1);
+        SearchIndex index1(cloud1);
+        neighbors_with_radius_Search(index1, p1, searchPoints1, searchPoint1);
+        K_nearest_neighbor_search(index1, K, searchPoint1, centroid1);
 
         printf("Point2\n");
-        neighbors_with_radius_Search(cloud2, p2, searchPoints2, searchPoint2);
-        K_nearest_neighbor_search(K, cloud2, searchPoint2, centroid2);
+        SearchIndex index2(cloud2);
+        neighbors_with_radius_Search(index2, p2, searchPoints2, searchPoint2);
+        K_nearest_neighbor_search(index2, K, searchPoint2, centroid2);
 
         printf("Point3\n");
-        neighbors_with_radius_Search(cloud3, p3, searchPoints3, searchPoint3);
-        K_nearest_neighbor_search(K, cloud3, searchPoint3, centroid3);
+        SearchIndex index3(cloud3);
+        neighbors_with_radius_Search(index3, p3, searchPoints3, searchPoint3);
+        K_nearest_neighbor_search(index3, K, searchPoint3, centroid3);
 
         printf("Point4\n");
-        neighbors_with_radius_Search(cloud4, p4, searchPoints4, searchPoint4);
-        K_nearest_neighbor_search(K, cloud4, searchPoint4, centroid4);
+        SearchIndex index4(cloud4);
+        neighbors_with_radius_Search(index4, p4, searchPoints4, searchPoint4);
+        K_nearest_neighbor_search(index4, K, searchPoint4, centroid4);
 
         average_p0.points[COUNT] = centroid1;
         average_p1.points[COUNT] = centroid2;
@@ -10,11 +10,14 @@
 #include <sensor_fusion/outlier_removal.h>
 #include <sensor_fusion/pub_cloud.h>
 
+#include <numeric>
+
 using namespace std;
 
 ros::Publisher pub_pickup;
 ros::Publisher pub_plane;
 ros::Publisher pub_outlier;
+ros::Publisher pub_cluster;
 
 // このパラメータで取得する点群のエリアを確定する
 // キャリブレーションボードが収まる範囲に調整すること
@@ -36,6 +39,22 @@ void pickup(CloudAPtr cloud, CloudAPtr& output)
     }
 }
 
+// 外れ値を除いたボードを1つのクラスタとして、大きさ, 重心と点を sensor_fusion/Cluster で出す
+void pub_board(CloudAPtr cloud, std_msgs::Header header, ros::Publisher pub)
+{
+    ClusterStats stats;
+    compute_cluster_stats(*cloud, stats);
+    vector<int> indices(cloud->points.size());
+    iota(indices.begin(), indices.end(), 0);
+
+    sensor_fusion::Cluster msg;
+    to_cluster_msg(*cloud, indices, stats, msg);
+    msg.centroid.header.stamp = ros::Time::now();
+    msg.centroid.header.frame_id = header.frame_id;
+    msg.points.header = msg.centroid.header;
+    pub.publish(msg);
+}
+
 void pcCallback(const sensor_msgs::PointCloud2ConstPtr msg)
 {
     CloudAPtr cloud(new CloudA);
@@ -57,6 +76,7 @@ void pcCallback(const sensor_msgs::PointCloud2ConstPtr msg)
     if(0<plane_cloud->points.size()){
         outlier_removal(plane_cloud, outlier_cloud);
         pub_cloud(outlier_cloud, msg->header, pub_outlier);
+        pub_board(outlier_cloud, msg->header, pub_cluster);
     }
 }
 
@@ -79,6 +99,7 @@ int main(int argc, char**argv)
     pub_pickup = n.advertise<sensor_msgs::PointCloud2>("/output/pickup", 10);
     pub_plane  = n.advertise<sensor_msgs::PointCloud2>("/output/plane" , 10);
     pub_outlier = n.advertise<sensor_msgs::PointCloud2>("/output/outlier", 10);
+    pub_cluster = n.advertise<sensor_fusion::Cluster>("/output/cluster", 10);
 
     ros::spin();
 
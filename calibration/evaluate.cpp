@@ -4,8 +4,7 @@
 #include <iostream>
 #include <pcl/point_types.h>
 
-#define MIN(x, y) ((x) < (y) ? (x) : (y))
-#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#include <sensor_fusion/ground_segmentation.h>
 
 using namespace std;
 
@@ -21,6 +20,8 @@ int grid_dimentions;
 double cell_size;
 double THRESHOLD;
 
+MinMaxGroundSegmentation ground_segmentation;
+
 // PickUp Cloud
 template<typename T_ptr>
 void pickup_cloud(T_ptr cloud, T_ptr& output)
@@ -38,45 +39,8 @@ void pickup_cloud(T_ptr cloud, T_ptr& output)
 template<typename T_ptr>
 void constructFullClouds(T_ptr cloud, T_ptr& rm_ground, T_ptr& ground)
 {
-    float min[grid_dimentions][grid_dimentions];
-    float max[grid_dimentions][grid_dimentions];
-    bool init[grid_dimentions][grid_dimentions];
-    memset(&min,  0, grid_dimentions*grid_dimentions);
-    memset(&max,  0, grid_dimentions*grid_dimentions); 
-    memset(&init, 0, grid_dimentions*grid_dimentions);
-
-    for(size_t i=0;i<cloud->points.size();i++)
-    {
-        int x = (grid_dimentions/2)+cloud->points[i].x/cell_size;
-        int y = (grid_dimentions/2)+cloud->points[i].y/cell_size;
-
-        if(0<x && x<grid_dimentions && 0<=y && y<grid_dimentions)
-        {
-            if(!init[x][y]){
-                min[x][y] = cloud->points[i].z;
-                max[x][y] = cloud->points[i].z;
-                init[x][y] = true;
-            }
-            else{
-                min[x][y] = MIN(min[x][y], cloud->points[i].z);
-                max[x][y] = MAX(max[x][y], cloud->points[i].z);
-            }
-        }
-    }
+    ground_segmentation.segment(*cloud, *rm_ground, *ground);
 
-    for(size_t i=0;i<cloud->points.size();i++)
-    {
-        int x = (grid_dimentions/2)+cloud->points[i].x/cell_size;
-        int y = (grid_dimentions/2)+cloud->points[i].y/cell_size;
-        
-        if(0<=x && x<grid_dimentions && 0<=y && y<grid_dimentions)
-        {
-            if(THRESHOLD<max[x][y]-min[x][y])
-                rm_ground->points.push_back(cloud->points[i]);
-            else
-                ground->points.push_back(cloud->points[i]);
-        }
-    }
     cout<<"----Remove Ground (Min Max): "<<rm_ground->points.size()<<endl; 
     cout<<"----Ground (Min Max): "<<ground->points.size()<<endl;
 }
@@ -164,6 +128,10 @@ int main(int argc, char** argv)
     nh.getParam("grid_dimentions", grid_dimentions);
     nh.getParam("cell_size", cell_size);
 
+    ground_segmentation.setGridDimentions(grid_dimentions);
+    ground_segmentation.setCellSize(cell_size);
+    ground_segmentation.setHeightThreshold(THRESHOLD);
+
     ros::Subscriber sub = nh.subscribe("/cloud", 10, pcCallback< pcl::PointCloud<pcl::PointXYZRGB>::Ptr, pcl::PointCloud<pcl::PointXYZRGB> >);
 
     pub_obstacle = nh.advertise<sensor_msgs::PointCloud2>("/obstacle", 10);
@@ -5,9 +5,13 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 #include <pcl/registration/icp.h>
+#include <pcl/search/kdtree.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
+#include <tf/transform_datatypes.h>
+
+#include <sensor_fusion/voxel_filter.h>
 
 using namespace std;
 using namespace sensor_msgs;
@@ -16,6 +20,13 @@ typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 
+// ICPの1段分の設定 (粗い段から順に行う)
+struct ICPLevel{
+    double leaf_size;                       // ダウンサンプリングのボクセルサイズ (0 : そのまま)
+    double max_correspondence_distance;
+    int max_iterations;
+};
+
 class icp_transform{
     public:
         icp_transform();
@@ -23,25 +34,65 @@ class icp_transform{
         void lidar_callback (const PointCloud2ConstPtr& cloud);  
         void camera_callback (const PointCloud2ConstPtr& cloud);
         void transform(const ros::TimerEvent&);
+        bool align(const Eigen::Matrix4f& initial, Eigen::Matrix4f& result, double& fitness);
 
         ros::NodeHandle nh;
+        ros::NodeHandle pnh;
 
         ros::Subscriber sub_lidar;
         ros::Subscriber sub_camera;
 
-        PointCloud2 cloud2_lidar;
-        PointCloud2 cloud2_camera;
-        
         CloudAPtr pcl_lidar;
         CloudAPtr pcl_camera;
 
+        // coarse-to-fine の各段
+        vector<ICPLevel> levels;
+        // 各段の target (lidar) とその探索木 (lidarが更新されたときだけ作り直す)
+        vector<CloudAPtr> targets;
+        vector<pcl::search::KdTree<PointA>::Ptr> target_trees;
+
+        // 最後の段の fitness score (対応点の二乗距離の平均) がこれを超えた解は捨てる
+        double max_fitness_score;
+
+        // 前回の解 (次の初期値)
+        Eigen::Matrix4f last_transform;
+        bool updated;
+
         ros::Timer timer;
 };
 
+CloudAPtr downsample(CloudAPtr cloud, double leaf_size)
+{
+    if(leaf_size<=0.0) return cloud;
+    CloudAPtr output(new CloudA);
+    VoxelFilter<PointA> vg;
+    vg.setLeafSize(leaf_size);
+    vg.filter(*cloud, *output);
+    return output;
+}
+
 // コンストラクタ初期化
 icp_transform::icp_transform()
-    : pcl_lidar(new CloudA), pcl_camera(new CloudA)
+    : pnh("~"), pcl_lidar(new CloudA), pcl_camera(new CloudA),
+      last_transform(Eigen::Matrix4f::Identity()), updated(false)
 {
+    // leaf_sizes[i], max_correspondence_distances[i], max_iterations[i] が i段目の設定
+    vector<double> leaf_sizes, distances;
+    vector<int> iterations;
+    pnh.param("leaf_sizes", leaf_sizes, vector<double>{0.2, 0.05, 0.0});
+    pnh.param("max_correspondence_distances", distances, vector<double>{1.0, 0.3, 0.1});
+    pnh.param("max_iterations", iterations, vector<int>{20, 20, 10});
+    for(size_t i=0;i<leaf_sizes.size() && i<distances.size() && i<iterations.size();i++){
+        ICPLevel level;
+        level.leaf_size = leaf_sizes[i];
+        level.max_correspondence_distance = distances[i];
+        level.max_iterations = iterations[i];
+        levels.push_back(level);
+    }
+    targets.resize(levels.size());
+    target_trees.resize(levels.size());
+    pnh.param("max_fitness_score", max_fitness_score, 0.01);
+
     sub_lidar  = nh.subscribe<PointCloud2> ("/lidar" , 10, &icp_transform::lidar_callback, this);
     sub_camera = nh.subscribe<PointCloud2> ("/camera", 10, &icp_transform::camera_callback, this);
 
@@ -50,14 +101,24 @@ icp_transform::icp_transform()
 
 void icp_transform::lidar_callback(const PointCloud2ConstPtr& msg)
 {
-    cloud2_lidar = *msg;
+    // ICP が保持している点群を書き換えないように、毎回新しい点群に変換する
+    pcl_lidar.reset(new CloudA);
     pcl::fromROSMsg(*msg, *pcl_lidar);
+
+    // 各段の target と探索木はここで1回だけ作る
+    for(size_t i=0;i<levels.size();i++){
+        targets[i] = downsample(pcl_lidar, levels[i].leaf_size);
+        target_trees[i].reset(new pcl::search::KdTree<PointA>);
+        target_trees[i]->setInputCloud(targets[i]);
+    }
+    updated = true;
 }
 
 void icp_transform::camera_callback(const PointCloud2ConstPtr& msg)
 {
-    cloud2_camera = *msg;
+    pcl_camera.reset(new CloudA);
     pcl::fromROSMsg(*msg, *pcl_camera);
+    updated = true;
 }
 
 //表示関数
@@ -84,23 +145,68 @@ void calc_rpy(Eigen::Matrix4d matrix){
 }
 
 
+// initial から coarse-to-fine で ICP を行う
+// 粗い段の解を次の段の初期値にし、最後に行った段の fitness score を返す
+// hasConverged() は反復回数の上限に達しただけでも true になるので、fitness score も見て判定する
+bool icp_transform::align(const Eigen::Matrix4f& initial, Eigen::Matrix4f& result, double& fitness)
+{
+  Eigen::Matrix4f guess = initial;
+  bool aligned = false;
+  for(size_t i=0;i<levels.size();i++){
+    CloudAPtr source = downsample(pcl_camera, levels[i].leaf_size);
+    if(source->empty() || targets[i]->empty()) continue;
+
+    pcl::IterativeClosestPoint<PointA, PointA> icp;
+    icp.setMaxCorrespondenceDistance(levels[i].max_correspondence_distance);
+    icp.setMaximumIterations(levels[i].max_iterations);
+    icp.setTransformationEpsilon(1e-8);
+    icp.setEuclideanFitnessEpsilon(1e-8);
+
+    // target の探索木は作り直させない
+    icp.setSearchMethodTarget(target_trees[i], true);
+    icp.setInputTarget(targets[i]);
+    icp.setInputSource(source);
+
+    CloudA Final;
+    icp.align(Final, guess);
+    if(!icp.hasConverged()) continue;
+
+    guess = icp.getFinalTransformation();
+    fitness = icp.getFitnessScore();
+    aligned = true;
+  }
+  result = guess;
+  return aligned && fitness<=max_fitness_score;
+}
+
 void icp_transform::transform(const ros::TimerEvent&){
-  pcl::IterativeClosestPoint<PointA, PointA> icp;
-  
-  // icp.setMaxCorrespondenceDistance(0.1);
-  // icp.setMaximumIterations(100);
-  // icp.setTransformationEpsilon(1e-8);
-  // icp.setEuclideanFitnessEpsilon(1e-8);
-
-  icp.setInputTarget(pcl_lidar->makeShared());
-  icp.setInputSource(pcl_camera->makeShared());
-  
-  CloudA Final;
-  icp.align(Final);
+  // 入力が変わっていなければ解も変わらない
+  if(!updated || pcl_lidar->empty() || pcl_camera->empty()) return;
+  updated = false;
+
+  ros::WallTime start = ros::WallTime::now();
+
+  // 前回の解から始め、だめなら単位行列からやり直す
+  // どちらもだめなら前回の解をそのまま残す (誤った解を次の初期値にしない)
+  Eigen::Matrix4f result;
+  double fitness = -1.0;
+  bool accepted = align(last_transform, result, fitness);
+  if(!accepted && !last_transform.isIdentity()){
+    printf("ICP from the last solution rejected (fitness %.4f), retrying from identity\n", fitness);
+    fitness = -1.0;
+    accepted = align(Eigen::Matrix4f::Identity(), result, fitness);
+  }
+  if(!accepted){
+    printf("ICP rejected (fitness %.4f, max %.4f), keeping the last solution\n", fitness, max_fitness_score);
+    return;
+  }
+  last_transform = result;
+
+  printf("ICP time : %.1f [ms]  fitness : %.4f\n", (ros::WallTime::now() - start).toSec()*1000.0, fitness);
 
   //変換matrixを表示する
   Eigen::Matrix4d transformation_matrix = Eigen::Matrix4d::Identity ();
-  transformation_matrix = icp.getFinalTransformation ().cast<double>();
+  transformation_matrix = last_transform.cast<double>();
   print4x4Matrix (transformation_matrix);
   calc_rpy(transformation_matrix);
 }
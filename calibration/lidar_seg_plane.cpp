@@ -19,6 +19,8 @@
 #include <sensor_fusion/down_sampling.h>
 #include <sensor_fusion/pub_cloud.h>
 
+#include <numeric>
+
 typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
@@ -29,6 +31,7 @@ ros::Publisher pub_area;
 ros::Publisher pub_down_sample;
 ros::Publisher pub_plane;
 ros::Publisher pub_filtered;
+ros::Publisher pub_cluster;
 
 
 // このパラメータで取得する点群のエリアを確定する
@@ -51,6 +54,22 @@ void pickup_cloud(CloudAPtr cloud, CloudAPtr& output)
     }
 }
 
+// 外れ値を除いたボードを1つのクラスタとして、大きさ, 重心と点を sensor_fusion/Cluster で出す
+void pub_board(CloudAPtr cloud, std_msgs::Header header, ros::Publisher pub)
+{
+    ClusterStats stats;
+    compute_cluster_stats(*cloud, stats);
+    vector<int> indices(cloud->points.size());
+    iota(indices.begin(), indices.end(), 0);
+
+    sensor_fusion::Cluster msg;
+    to_cluster_msg(*cloud, indices, stats, msg);
+    msg.centroid.header.stamp = ros::Time::now();
+    msg.centroid.header.frame_id = header.frame_id;
+    msg.points.header = msg.centroid.header;
+    pub.publish(msg);
+}
+
 void pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
 {
     CloudAPtr input (new CloudA);
@@ -85,6 +104,8 @@ void pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
     // pub_cloud(ds_cloud, msg->header, pub_down_sample);
     pub_cloud(plane, msg->header, pub_plane);
     pub_cloud(filtered, msg->header, pub_filtered);
+    if(0<filtered->points.size())
+        pub_board(filtered, msg->header, pub_cluster);
 }
 
 int main(int argc, char** argv)
@@ -106,6 +127,7 @@ int main(int argc, char** argv)
     pub_down_sample = n.advertise<sensor_msgs::PointCloud2>("/down_sample", 10);
     pub_plane       = n.advertise<sensor_msgs::PointCloud2>("/plane", 10);
     pub_filtered     = n.advertise<sensor_msgs::PointCloud2>("/filtered", 10);
+    pub_cluster     = n.advertise<sensor_fusion::Cluster>("/cluster", 10);
 
 	ros::spin();
 
@@ -0,0 +1,162 @@
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/point_cloud.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <tf/tf.h>
+
+#include <sensor_fusion/extrinsic_calibration.h>
+
+using namespace std;
+
+typedef pcl::PointXYZ PointA;
+typedef pcl::PointCloud<PointA> CloudA;
+
+typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> TargetSyncPolicy;
+
+// LiDAR-カメラ外部パラメータのオンライン推定
+// lidar/camera_seg_circle が出すターゲットの検出を受け取るたびに推定値を更新し、
+// 共分散付きの姿勢として publish する
+// (icp_transform のように1秒ごとに単位行列からICPをやり直さない)
+class OnlineCalibration{
+    private:
+        ros::NodeHandle nh;
+        ros::NodeHandle pnh;
+
+        message_filters::Subscriber<sensor_msgs::PointCloud2> lidar_sub;
+        message_filters::Subscriber<sensor_msgs::PointCloud2> camera_sub;
+        message_filters::Synchronizer<TargetSyncPolicy> sync;
+
+        ros::Publisher extrinsic_pub;
+
+        ExtrinsicCalibration calibration;
+        bool reported;
+
+    public:
+        OnlineCalibration();
+
+        void targetCallback(const sensor_msgs::PointCloud2ConstPtr& lidar_msg,
+                            const sensor_msgs::PointCloud2ConstPtr& camera_msg);
+
+        void print();
+};
+
+OnlineCalibration::OnlineCalibration()
+    : nh(), pnh("~"),
+      lidar_sub(nh, "/lidar", 10), camera_sub(nh, "/camera", 10),
+      sync(TargetSyncPolicy(10), lidar_sub, camera_sub),
+      reported(false)
+{
+    int window_size, max_iterations, converge_count;
+    double max_correspondence_distance, converge_translation, converge_rotation;
+    pnh.param<int>("window_size", window_size, 50);
+    pnh.param<int>("max_iterations", max_iterations, 30);
+    pnh.param<double>("max_correspondence_distance", max_correspondence_distance, 0.1);
+    pnh.param<double>("converge_translation", converge_translation, 1e-3);
+    pnh.param<double>("converge_rotation", converge_rotation, 1e-3);
+    pnh.param<int>("converge_count", converge_count, 5);
+
+    calibration.setWindowSize(window_size);
+    calibration.setMaximumIterations(max_iterations);
+    calibration.setMaxCorrespondenceDistance(max_correspondence_distance);
+    calibration.setConvergence(converge_translation, converge_rotation, converge_count);
+
+    // 初期値 (x, y, z, roll, pitch, yaw) があれば使う
+    vector<double> initial;
+    if(pnh.getParam("initial_guess", initial) && initial.size()==6){
+        tf::Matrix3x3 rotation;
+        rotation.setRPY(initial[3], initial[4], initial[5]);
+        Eigen::Matrix4f guess = Eigen::Matrix4f::Identity();
+        for(int r=0;r<3;r++){
+            for(int c=0;c<3;c++)
+                guess(r, c) = rotation[r][c];
+            guess(r, 3) = initial[r];
+        }
+        calibration.setInitialGuess(guess);
+    }
+
+    sync.registerCallback(boost::bind(&OnlineCalibration::targetCallback, this, _1, _2));
+
+    extrinsic_pub = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>("/calibration/extrinsic", 10);
+}
+
+void OnlineCalibration::targetCallback(const sensor_msgs::PointCloud2ConstPtr& lidar_msg,
+                                       const sensor_msgs::PointCloud2ConstPtr& camera_msg)
+{
+    CloudA lidar, camera;
+    pcl::fromROSMsg(*lidar_msg, lidar);
+    pcl::fromROSMsg(*camera_msg, camera);
+
+    calibration.addObservation(lidar, camera);
+    if(!calibration.update()) return;
+
+    const Eigen::Matrix4f T = calibration.transform();
+    tf::Matrix3x3 rotation(T(0,0), T(0,1), T(0,2),
+                           T(1,0), T(1,1), T(1,2),
+                           T(2,0), T(2,1), T(2,2));
+    tf::Quaternion q;
+    rotation.getRotation(q);
+
+    geometry_msgs::PoseWithCovarianceStamped msg;
+    msg.header = lidar_msg->header;
+    msg.pose.pose.position.x = T(0, 3);
+    msg.pose.pose.position.y = T(1, 3);
+    msg.pose.pose.position.z = T(2, 3);
+    tf::quaternionTFToMsg(q, msg.pose.pose.orientation);
+    const ExtrinsicCalibration::Matrix6d& cov = calibration.covariance();
+    for(int r=0;r<6;r++)
+        for(int c=0;c<6;c++)
+            msg.pose.covariance[6*r+c] = cov(r, c);
+    extrinsic_pub.publish(msg);
+
+    if(calibration.converged() && !reported){
+        print();
+        reported = true;
+    }
+    else if(!calibration.converged()){
+        reported = false;
+    }
+}
+
+// 収束した推定値を表示する
+void OnlineCalibration::print()
+{
+    const Eigen::Matrix4f T = calibration.transform();
+    const ExtrinsicCalibration::Matrix6d& cov = calibration.covariance();
+
+    printf ("Converged (%d observations, %d correspondences, RMSE %.4f)\n",
+            calibration.observations(), calibration.correspondences(), calibration.getRMSE());
+    printf ("Rotation matrix :\n");
+    printf ("    | %6.3f %6.3f %6.3f | \n", T (0, 0), T (0, 1), T (0, 2));
+    printf ("R = | %6.3f %6.3f %6.3f | \n", T (1, 0), T (1, 1), T (1, 2));
+    printf ("    | %6.3f %6.3f %6.3f | \n", T (2, 0), T (2, 1), T (2, 2));
+    printf ("Translation vector :\n");
+    printf ("t = < %6.3f, %6.3f, %6.3f >\n", T (0, 3), T (1, 3), T (2, 3));
+
+    tf::Matrix3x3 rotation(T(0,0), T(0,1), T(0,2),
+                           T(1,0), T(1,1), T(1,2),
+                           T(2,0), T(2,1), T(2,2));
+    double roll, pitch, yaw;
+    rotation.getRPY(roll, pitch, yaw, 1);
+    printf("Roll Pitch Yaw :\n");
+    printf("RPY = < %6.3f, %6.3f, %6.3f >\n", roll, pitch, yaw);
+    printf("Standard deviation (x y z roll pitch yaw) :\n");
+    printf("< %.4f %.4f %.4f %.4f %.4f %.4f >\n\n",
+           sqrt(cov(0,0)), sqrt(cov(1,1)), sqrt(cov(2,2)), sqrt(cov(3,3)), sqrt(cov(4,4)), sqrt(cov(5,5)));
+}
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "online_calibration");
+
+    OnlineCalibration online_calibration;
+
+    ros::spin();
+
+    return 0;
+}
@@ -24,6 +24,10 @@
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
 
+#include <sensor_fusion/soa_cloud.h>
+
+#include <limits>
+
 using namespace std;
 using namespace sensor_msgs;
 using namespace message_filters;
@@ -54,37 +58,35 @@ void callback(const ImageConstPtr& image_msg,
     cv::Mat image(cv_img_ptr->image.rows, cv_img_ptr->image.cols, cv_img_ptr->image.type());
     image = cv_bridge::toCvShare(image_msg)->image;
     
-    // camera info
-    image_geometry::PinholeCameraModel cam_model_;
-    cam_model_.fromCameraInfo(cinfo_msg);
-
     // Coloring Step
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr area(new pcl::PointCloud<pcl::PointXYZRGB>);
-	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
-    pcl::fromROSMsg(pc_msg, *cloud);
-	cloud->header.frame_id = pc_msg.header.frame_id;
-	
-	cout<<"Input Size : "<<cloud->points.size()
+    // PointCloud2から座標だけをSoACloudに取り出し、画角内の点だけを色付きの点にする
+    SoACloud cloud;
+    if(!to_soa(pc_msg, cloud)) return;
+
+	cout<<"Input Size : "<<cloud.size()
 		<<" Frame : "<<pc_msg.header.frame_id<<endl;
-    for(pcl::PointCloud<pcl::PointXYZ>::iterator pt = cloud->points.begin(); pt < cloud->points.end(); pt++)
+
+    const Eigen::Matrix<float, 3, 4> projection = laser_to_image_projection(*cinfo_msg);
+
+    vector<int> indices;
+    frustum_cull(cloud, projection, image.cols, image.rows, 0.0f, numeric_limits<float>::max(), indices);
+
+    SoACloud visible;
+    to_soa(cloud, indices, visible);
+
+    vector<float> u, v, range;
+    project_points(visible, projection, u, v, range);
+
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr area(new pcl::PointCloud<pcl::PointXYZRGB>);
+    from_soa(visible, *area);
+    for(int i=0;i<visible.size();i++)
     {
-        if ((*pt).x<0) continue;
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model_.project3dToPixel(pt_cv);
-
-        if(uv.x>0 && uv.x < image.cols && uv.y > 0 && uv.y < image.rows)
-        {
-            pcl::PointXYZRGB p;
-            p.x = (*pt).x;
-            p.y = (*pt).y;
-            p.z = (*pt).z;
-            p.b = image.at<cv::Vec3b>(uv)[0];
-            p.g = image.at<cv::Vec3b>(uv)[1];
-            p.r = image.at<cv::Vec3b>(uv)[2];
-
-            area->points.push_back(p);
-        }
+        const int x = min(int(u[i]), image.cols-1);
+        const int y = min(int(v[i]), image.rows-1);
+        const cv::Vec3b& color = image.at<cv::Vec3b>(y, x);
+        area->points[i].b = color[0];
+        area->points[i].g = color[1];
+        area->points[i].r = color[2];
     }
     
     cout<<"Points size : "<< area->points.size() << endl;
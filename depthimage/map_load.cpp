@@ -9,12 +9,13 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 #include <pcl/filters/extract_indices.h>
-#include <pcl/filters/voxel_grid.h>
 
 #include <pcl/visualization/pcl_visualizer.h>
 
 #include <pcl_ros/point_cloud.h>
 
+#include <sensor_fusion/voxel_filter.h>
+
 using namespace std;
 
 
@@ -59,11 +60,11 @@ int main(int argc, char** argv)
     loadPCDFile(cloud);
 
     //Downsample//
-    pcl::VoxelGrid<pcl::PointXYZRGBNormal> vg;  
+    // 地図全体を 0.01 で分けると pcl::VoxelGrid ではボクセル番号が int に収まらない
+    VoxelFilter<pcl::PointXYZRGBNormal> vg;
     pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr ds_cloud (new pcl::PointCloud<pcl::PointXYZRGBNormal>);  
-    vg.setInputCloud (cloud);  
-    vg.setLeafSize (0.01f, 0.01f, 0.01f);
-    vg.filter (*ds_cloud);
+    vg.setLeafSize (0.01f);
+    vg.filter (*cloud, *ds_cloud);
     cout<<"----DownSampling:"<<ds_cloud->points.size()<<endl;
 
     while(ros::ok())
@@ -7,8 +7,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#define MIN(x, y) ((x) < (y) ? (x) : (y))
-#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#include <sensor_fusion/ground_segmentation.h>
 
 typedef pcl::PointXYZRGBNormal PointA;
 typedef pcl::PointCloud<PointA> CloudA;
@@ -24,10 +23,17 @@ class MIN_MAX{
         string RM_GROUND_PATH;
         string GROUND_PATH;
 
+        // 統合Mapを直接処理する場合のみ指定
+        string MAP_FILE;
+        string MAP_NAME;
+
         int grid_dimentions;
         double cell_size;
         double height_threshold;
 
+        MinMaxGroundSegmentation ground_segmentation;
+        SparseMinMaxGroundSegmentation sparse_ground_segmentation;
+
     public:
         MIN_MAX();
 
@@ -36,10 +42,13 @@ class MIN_MAX{
 
         void load(CloudAPtr& cloud, int count);
         void save(CloudAPtr cloud, string file_path,int count);
+        void save(CloudAPtr cloud, string file_name);
 
         void constructFullClouds(CloudAPtr cloud, CloudAPtr& obstacle, CloudAPtr& ground);
+        void constructMapClouds(CloudAPtr cloud, CloudAPtr& obstacle, CloudAPtr& ground);
         
         void main();
+        void map_main();
 };
 
 
@@ -49,9 +58,18 @@ MIN_MAX::MIN_MAX()
     nh.getParam("FILE_PATH",        FILE_PATH);
     nh.getParam("RM_GROUND_PATH",   RM_GROUND_PATH);
     nh.getParam("GROUND_PATH",      GROUND_PATH);
+    nh.param<string>("MAP_FILE",    MAP_FILE, "");
+    nh.param<string>("MAP_NAME",    MAP_NAME, "map.pcd");
     nh.getParam("grid_dimentions",  grid_dimentions);
     nh.getParam("cell_size",        cell_size);
     nh.getParam("height_threshold", height_threshold);
+
+    ground_segmentation.setGridDimentions(grid_dimentions);
+    ground_segmentation.setCellSize(cell_size);
+    ground_segmentation.setHeightThreshold(height_threshold);
+
+    sparse_ground_segmentation.setCellSize(cell_size);
+    sparse_ground_segmentation.setHeightThreshold(height_threshold);
 }
 
 int MIN_MAX::file_count_boost(const boost::filesystem::path& root) {
@@ -108,48 +126,30 @@ void MIN_MAX::save(CloudAPtr cloud, string file_path, int count)
     cout<<"----Save :" <<file_name <<endl;
 }
 
+void MIN_MAX::save(CloudAPtr cloud, string file_name)
+{
+    cloud->width = 1;
+    cloud->height = cloud->points.size();
+
+    pcl::io::savePCDFileBinary(file_name, *cloud);
+    cout<<"----Save :" <<file_name <<endl;
+}
+
 
 void MIN_MAX::constructFullClouds(CloudAPtr cloud, CloudAPtr& rm_ground, CloudAPtr& ground)
 {
-    float min[grid_dimentions][grid_dimentions];
-    float max[grid_dimentions][grid_dimentions];
-    bool init[grid_dimentions][grid_dimentions];
-    memset(&min,  0, grid_dimentions*grid_dimentions);
-    memset(&max,  0, grid_dimentions*grid_dimentions); 
-    memset(&init, 0, grid_dimentions*grid_dimentions);
-
-    for(size_t i=0;i<cloud->points.size();i++)
-    {
-        int x = (grid_dimentions/2)+cloud->points[i].x/cell_size;
-        int y = (grid_dimentions/2)+cloud->points[i].y/cell_size;
-
-        if(0<x && x<grid_dimentions && 0<=y && y<grid_dimentions)
-        {
-            if(!init[x][y]){
-                min[x][y] = cloud->points[i].z;
-                max[x][y] = cloud->points[i].z;
-                init[x][y] = true;
-            }
-            else{
-                min[x][y] = MIN(min[x][y], cloud->points[i].z);
-                max[x][y] = MAX(max[x][y], cloud->points[i].z);
-            }
-        }
-    }
+    ground_segmentation.segment(*cloud, *rm_ground, *ground);
 
-    for(size_t i=0;i<cloud->points.size();i++)
-    {
-        int x = (grid_dimentions/2)+cloud->points[i].x/cell_size;
-        int y = (grid_dimentions/2)+cloud->points[i].y/cell_size;
-        
-        if(0<=x && x<grid_dimentions && 0<=y && y<grid_dimentions)
-        {
-            if(height_threshold<max[x][y]-min[x][y])
-                rm_ground->points.push_back(cloud->points[i]);
-            else
-                ground->points.push_back(cloud->points[i]);
-        }
-    }
+    cout<<"----Remove Ground (Min Max): "<<rm_ground->points.size()<<endl; 
+    cout<<"----Ground (Min Max): "<<ground->points.size()<<endl;
+}
+
+// global座標系の統合Mapは範囲が決まらないので疎グリッドで処理する
+void MIN_MAX::constructMapClouds(CloudAPtr cloud, CloudAPtr& rm_ground, CloudAPtr& ground)
+{
+    sparse_ground_segmentation.segment(*cloud, *rm_ground, *ground);
+
+    cout<<"----Cells: "<<sparse_ground_segmentation.occupiedCells()<<endl;
     cout<<"----Remove Ground (Min Max): "<<rm_ground->points.size()<<endl; 
     cout<<"----Ground (Min Max): "<<ground->points.size()<<endl;
 }
@@ -175,14 +175,38 @@ void MIN_MAX::main()
     }
 }
 
+void MIN_MAX::map_main()
+{
+    CloudAPtr load_cloud(new CloudA);
+    CloudAPtr rm_ground(new CloudA);
+    CloudAPtr ground(new CloudA);
+
+    cout<<"----Load :" <<MAP_FILE<<endl;
+    if (pcl::io::loadPCDFile<PointA> (MAP_FILE, *load_cloud) == -1)
+    {
+        PCL_ERROR ("----Couldn't read file\n");
+        return;
+    }
+
+    constructMapClouds(load_cloud, rm_ground, ground);
+    save(rm_ground, RM_GROUND_PATH + MAP_NAME);
+    save(ground, GROUND_PATH + MAP_NAME);
+}
+
 int main(int argc, char** argv)
 {
     ros::init(argc, argv, "normal_estimation_local");
 
     MIN_MAX min_max;
-    
 
-    min_max.main();
+    ros::NodeHandle nh("~");
+    string map_file;
+    nh.param<string>("MAP_FILE", map_file, "");
+
+    if(map_file.empty())
+        min_max.main();
+    else
+        min_max.map_main();
 
     return 0;
 }
@@ -5,11 +5,55 @@
 #include <pcl/point_types.h>
 #include <pcl/features/normal_3d_omp.h>
 
+#include <sensor_fusion/normal_estimation.h>
+
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace std;
 
+// 同時に処理するノードの推定メモリの合計を limit 以下に抑える (limit = 0 なら無制限)
+// 1ノードだけで limit を超える場合も、他に処理中のノードがなければ通す
+class MemoryBudget{
+    private:
+        mutex mtx;
+        condition_variable cv;
+        size_t limit;
+        size_t used;
+
+    public:
+        MemoryBudget(size_t limit_) : limit(limit_), used(0) {}
+
+        void acquire(size_t bytes)
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [&]{ return limit==0 || used==0 || used+bytes<=limit; });
+            used += bytes;
+        }
+
+        void release(size_t bytes)
+        {
+            {
+                lock_guard<mutex> lock(mtx);
+                used -= bytes;
+            }
+            cv.notify_all();
+        }
+};
+
 class NormalEstimation{
     private:
         ros::NodeHandle nh;
@@ -18,18 +62,33 @@ class NormalEstimation{
         string NORMAL_PATH;
         double search_radius;
 
+        // batch
+        // workers 個のスレッドでノードを並列に処理する (各ノードの中はOpenMPで残りのコアを使う)
+        int workers;
+        double memory_budget;
+        int max_neighbors;
+        bool binary;
+        double neighbors_per_point;     // memory_estimate で使う1点あたりの近傍数
+
+        mutex print_mtx;
+
     public:
         NormalEstimation();
 
         int file_count_boost(const boost::filesystem::path& root);
 
-        bool check_node(int count);
+        int check_node(int count);
 
-        void load(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, int count);
+        double sample_neighbors(int count, int samples);
+        size_t memory_estimate(int points, int threads);
+
+        bool load(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, int count);
         void save(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud, int count);
 
         void normal_estimation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                                pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& cloud_normal);
+        double process_node(int count, int points);
+
         void main();
 };
 
@@ -39,6 +98,11 @@ NormalEstimation::NormalEstimation()
     nh.getParam("search_radius", search_radius);
     nh.getParam("FILE_PATH"    , FILE_PATH);
     nh.getParam("NORMAL_PATH" , NORMAL_PATH);
+    nh.param<int>("workers", workers, 1);
+    nh.param<double>("memory_budget", memory_budget, 0.0);
+    nh.param<int>("max_neighbors", max_neighbors, 0);
+    nh.param<bool>("binary", binary, true);
+    neighbors_per_point = (0<max_neighbors) ? max_neighbors : 100;
 }
 
 int NormalEstimation::file_count_boost(const boost::filesystem::path& root) {
@@ -53,95 +117,129 @@ int NormalEstimation::file_count_boost(const boost::filesystem::path& root) {
     return result;
 }
 
-bool NormalEstimation::check_node(int count)
+// ノードのPCDのヘッダだけを読んで点数を返す (なければ -1)
+int NormalEstimation::check_node(int count)
+{
+    string file_name = FILE_PATH + to_string(count) + ".pcd";
+    if(!boost::filesystem::exists(file_name)) return -1;
+
+    pcl::PCDReader reader;
+    pcl::PCLPointCloud2 header;
+    Eigen::Vector4f origin;
+    Eigen::Quaternionf orientation;
+    int pcd_version, data_type;
+    unsigned int data_idx;
+    if (reader.readHeader(file_name, header, origin, orientation, pcd_version, data_type, data_idx) < 0)
+        return -1;
+    return int(header.width*header.height);
+}
+
+// ノードの点群から等間隔に最大 samples 点を選んで半径探索し、1点あたりの近傍数の平均を返す (読めなければ -1)
+// max_neighbors 未指定時の memory_estimate に使う
+double NormalEstimation::sample_neighbors(int count, int samples)
 {
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+    if(!load(cloud, count)) return -1.0;
+    const int size = int(cloud->points.size());
 
-    string file_name = FILE_PATH + to_string(count) + ".pcd";
-    
-    if (pcl::io::loadPCDFile<pcl::PointXYZRGB> (file_name, *cloud) == -1) //* load the file
-    {
-        printf("Node %d is none\n\n", count);
-        return false;
-    }
-    else{
-        printf("Node : %d\n", count);
-        return true;
+    pcl::KdTreeFLANN<pcl::PointXYZRGB> kdtree;
+    kdtree.setInputCloud(cloud);
+
+    const int n = min(samples, size);
+    vector<int> indices;
+    vector<float> distances;
+    double total = 0.0;
+    for(int k=0;k<n;k++){
+        const pcl::PointXYZRGB& p = cloud->points[size_t(k)*size/n];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        total += kdtree.radiusSearch(p, search_radius, indices, distances);
     }
+    return total/n;
+}
+
+// 1ノードの処理で同時に確保するメモリの見積もり [byte] (threads はノード内のOpenMPのスレッド数)
+// 次の3つの段階のうち最大のもの
+//     読み込み   : PCDの PCLPointCloud2 + 入力点群 (PCDのフィールドは PointXYZRGB 以下とする)
+//     近傍グラフ : 入力点群 + KdTreeFLANN + 近傍グラフ
+//     法線       : 入力点群 + 近傍グラフ + 出力点群
+// KdTreeFLANN は座標のコピー, 添字, 木で1点あたり約32byteとする
+// 近傍グラフは1点あたり neighbors_per_point 近傍と先頭, 数に、スレッドごとにチャンク1つの余りを足す
+// neighbors_per_point が標本からの見積もりなら、これも見積もりで上限ではない
+size_t NormalEstimation::memory_estimate(int points, int threads)
+{
+    const size_t n = size_t(points);
+    const size_t cloud = n*sizeof(pcl::PointXYZRGB);
+    const size_t blob = n*sizeof(pcl::PointXYZRGB);
+    const size_t kdtree = n*32;
+    const size_t graph = size_t(ceil(n*neighbors_per_point))*sizeof(int)
+                       + n*(sizeof(const int*) + sizeof(int))
+                       + size_t(threads)*NeighborGraph::chunk_size()*sizeof(int);
+    const size_t output = n*sizeof(pcl::PointXYZRGBNormal);
+    return max(blob + cloud, cloud + graph + max(kdtree, output));
 }
 
-void NormalEstimation::load(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, int count)
+// 読めないか点がなければ false
+bool NormalEstimation::load(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, int count)
 {
     string file_name = FILE_PATH + to_string(count) + ".pcd";
-    cout<<"-----Load :" <<file_name<<endl;
-    
     if (pcl::io::loadPCDFile<pcl::PointXYZRGB> (file_name, *cloud) == -1) //* load the file
     {
         PCL_ERROR ("-----Couldn't read file\n");
+        return false;
     }
+    return !cloud->points.empty();
 }
 
 void NormalEstimation::save(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud, int count)
 {
-    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr save_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-    pcl::copyPointCloud(*cloud, *save_cloud);
-
-    save_cloud->width = 1;
-    save_cloud->height = save_cloud->points.size();
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
 
     string file_name=NORMAL_PATH+to_string(count)+".pcd";
 
-    pcl::io::savePCDFileASCII(file_name, *save_cloud);
-    cout<<"-----Save :" <<file_name <<endl;
+    if(binary) pcl::io::savePCDFileBinary(file_name, *cloud);
+    else       pcl::io::savePCDFileASCII(file_name, *cloud);
 }
 
 void NormalEstimation::normal_estimation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                                          pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& cloud_normal)
 {
-	cout<<"-----Normal Estimation"<<endl;
-    pcl::NormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
-    ne.setInputCloud(cloud);
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZRGB> ());
-    ne.setSearchMethod (tree);
-    pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-    ne.setRadiusSearch (search_radius);
-    ne.compute(*normals);
-
-    pcl::PointXYZRGBNormal tmp;
-    for(size_t i=0;i<cloud->points.size();i++)
+    // 近傍グラフは1回だけ作り、法線は並列に確保済みの出力へ書き込む (近傍が足りない点は法線0)
+    NeighborGraph graph;
+    build_neighbor_graph<pcl::PointXYZRGB>(cloud, search_radius, graph, max_neighbors);
+    estimate_normals(*cloud, graph, *cloud_normal);
+}
+
+// 1ノードを読み込んで法線を求めて保存し、かかった時間 [s] を返す
+// 読めなければ保存せずに -1 を返す
+double NormalEstimation::process_node(int count, int points)
+{
+    typedef chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr load_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+
+    if(!load(load_cloud, count)){
+        lock_guard<mutex> lock(print_mtx);
+        printf("Node %d : couldn't load (or no points), skipped\n", count);
+        return -1.0;
+    }
+    const Clock::time_point loaded = Clock::now();
+    normal_estimation(load_cloud, normal_cloud);
+    const Clock::time_point estimated = Clock::now();
+    save(normal_cloud, count);
+    const Clock::time_point saved = Clock::now();
+
+    const double load_time = chrono::duration<double>(loaded - start).count();
+    const double normal_time = chrono::duration<double>(estimated - loaded).count();
+    const double save_time = chrono::duration<double>(saved - estimated).count();
     {
-		tmp.x = cloud->points[i].x;
-		tmp.y = cloud->points[i].y;
-		tmp.z = cloud->points[i].z;
-		tmp.r = cloud->points[i].r;
-		tmp.g = cloud->points[i].g;
-		tmp.b = cloud->points[i].b;
-		if(!isnan(normals->points[i].normal_x)){
-			tmp.normal_x = normals->points[i].normal_x;
-		}
-		else{
-			tmp.normal_x = 0.0;
-		}
-		if(!isnan(normals->points[i].normal_y)){
-			tmp.normal_y = normals->points[i].normal_y;
-		}
-		else{
-			tmp.normal_y = 0.0;
-		}
-		if(!isnan(normals->points[i].normal_z)){
-			tmp.normal_z = normals->points[i].normal_z;
-		}
-		else{
-			tmp.normal_z = 0.0;
-		}
-		if(!isnan(normals->points[i].curvature)){
-			tmp.curvature = normals->points[i].curvature;
-		}
-		else{
-			tmp.curvature = 0.0;
-		}
-		cloud_normal->points.push_back(tmp);
-	}
+        lock_guard<mutex> lock(print_mtx);
+        printf("Node %d : %d points  load %.2f s  normal %.2f s  save %.2f s\n",
+               count, points, load_time, normal_time, save_time);
+    }
+    return chrono::duration<double>(saved - start).count();
 }
 
 void NormalEstimation::main()
@@ -149,17 +247,73 @@ void NormalEstimation::main()
     int size = file_count_boost(FILE_PATH.c_str());
     printf("PCD File Size : %d\n", size);
 
+    // 処理するノードと点数
+    vector<int> nodes, points;
     for(int i=0;i<size;i++)
     {
-        if(!check_node(i)) continue;
+        const int n = check_node(i);
+        if(n<0){
+            printf("Node %d is none\n", i);
+            continue;
+        }
+        nodes.push_back(i);
+        points.push_back(n);
+    }
+
+    const int num_workers = max(1, min(workers, int(nodes.size())));
+    int threads_per_worker = 1;
+#ifdef _OPENMP
+    threads_per_worker = max(1, omp_get_max_threads()/num_workers);
+#endif
+    // 近傍数の上限がなければ、最も点数の多いノードで近傍数を見積もる
+    // (同じセンサ, 同じダウンサンプリングのノードなら密度はほぼ同じなので、1ノードの標本で全ノードに使う)
+    // ノードごとの密度のばらつきの分、標本の平均より2割多く見ておく
+    if(0<memory_budget && max_neighbors<=0 && !nodes.empty())
+    {
+        const int largest = int(max_element(points.begin(), points.end()) - points.begin());
+        const double sampled = sample_neighbors(nodes[largest], 1000);
+        if(0.0<sampled){
+            neighbors_per_point = 1.2*sampled;
+            printf("Neighbors per point : %.1f (sampled from node %d)\n", neighbors_per_point, nodes[largest]);
+        }
+        else printf("Neighbors per point : %.1f (couldn't sample node %d)\n", neighbors_per_point, nodes[largest]);
+    }
+
+    printf("Nodes : %d  Workers : %d x %d threads  Memory budget : %.0f MB\n",
+           int(nodes.size()), num_workers, threads_per_worker, memory_budget);
 
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr load_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-        pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+    MemoryBudget budget(size_t(memory_budget*1024.0*1024.0));
+    atomic<int> next(0);
+    vector<double> node_time(nodes.size(), 0.0);
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> pool;
+    for(int w=0;w<num_workers;w++)
+    {
+        pool.push_back(thread([&]{
+#ifdef _OPENMP
+            omp_set_num_threads(threads_per_worker);
+#endif
+            for(int k=next++;k<int(nodes.size());k=next++)
+            {
+                const size_t bytes = memory_estimate(points[k], threads_per_worker);
+                budget.acquire(bytes);
+                node_time[k] = process_node(nodes[k], points[k]);
+                budget.release(bytes);
+            }
+        }));
+    }
+    for(size_t w=0;w<pool.size();w++) pool[w].join();
+    const double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-        load(load_cloud, i);
-        normal_estimation(load_cloud, normal_cloud);
-        save(normal_cloud, i);
+    double total = 0.0;
+    int skipped = 0;
+    for(size_t k=0;k<node_time.size();k++){
+        if(node_time[k]<0.0) skipped++;
+        else total += node_time[k];
     }
+    printf("Finished %d nodes in %.2f s (sum of node time %.2f s)\n", int(nodes.size()) - skipped, elapsed, total);
+    if(0<skipped) printf("Skipped %d nodes that couldn't be loaded\n", skipped);
 }
 
 
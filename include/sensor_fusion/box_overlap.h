@@ -0,0 +1,152 @@
+#ifndef _BOX_OVERLAP_H_
+#define _BOX_OVERLAP_H_
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "Eigen/Core"
+
+// 画像上の矩形同士の重なり(IoU)
+// クラスタのAABBを1回だけ投影して矩形にし、矩形は x0,y0,x1,y1 を別々の配列で持つ
+// IoU行列の1行分は独立な min/max と積だけのループなのでSIMD化される
+
+// 画像上の矩形の集合 (x0 <= x < x1, y0 <= y < y1)
+struct ImageBoxes{
+    std::vector<float> x0;
+    std::vector<float> y0;
+    std::vector<float> x1;
+    std::vector<float> y1;
+
+    int size() const { return int(x0.size()); }
+
+    void resize(int size)
+    {
+        x0.resize(size);
+        y0.resize(size);
+        x1.resize(size);
+        y1.resize(size);
+    }
+
+    float area(int i) const { return (x1[i]-x0[i])*(y1[i]-y0[i]); }
+};
+
+// AABB(min_p, max_p)の8頂点を投影し、それを囲む矩形を求める
+// projection は laser_to_image_projection() の行列
+// 頂点が1つでも奥行き near 以下なら、画像に正しく写らないので面積0の矩形にする
+// 矩形は画像(width x height)の範囲に切り詰める
+inline void project_boxes(const std::vector<Eigen::Vector3f>& min_p,
+                          const std::vector<Eigen::Vector3f>& max_p,
+                          const Eigen::Matrix<float, 3, 4>& projection,
+                          int width, int height, float near,
+                          ImageBoxes& boxes)
+{
+    const int size = int(min_p.size());
+    boxes.resize(size);
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        float u0 =  std::numeric_limits<float>::max();
+        float v0 =  std::numeric_limits<float>::max();
+        float u1 = -std::numeric_limits<float>::max();
+        float v1 = -std::numeric_limits<float>::max();
+        bool visible = true;
+        for(int c=0;c<8;c++){
+            const Eigen::Vector4f p((c&1) ? max_p[i][0] : min_p[i][0],
+                                    (c&2) ? max_p[i][1] : min_p[i][1],
+                                    (c&4) ? max_p[i][2] : min_p[i][2],
+                                    1.0f);
+            const Eigen::Vector3f q = projection*p;
+            if(q[2]<=near){
+                visible = false;
+                break;
+            }
+            u0 = std::min(u0, q[0]/q[2]);
+            v0 = std::min(v0, q[1]/q[2]);
+            u1 = std::max(u1, q[0]/q[2]);
+            v1 = std::max(v1, q[1]/q[2]);
+        }
+        if(visible){
+            u0 = std::max(u0, 0.0f);
+            v0 = std::max(v0, 0.0f);
+            u1 = std::min(u1, float(width));
+            v1 = std::min(v1, float(height));
+        }
+        if(!visible || u1<=u0 || v1<=v0)
+            u0 = v0 = u1 = v1 = 0.0f;
+        boxes.x0[i] = u0;
+        boxes.y0[i] = v0;
+        boxes.x1[i] = u1;
+        boxes.y1[i] = v1;
+    }
+}
+
+// 全ての組のIoU (iou[i*N+j], 対角は面積があれば1)
+inline void iou_matrix(const ImageBoxes& boxes, std::vector<float>& iou)
+{
+    const int size = boxes.size();
+    iou.assign(size_t(size)*size, 0.0f);
+
+    const float* x0 = boxes.x0.data();
+    const float* y0 = boxes.y0.data();
+    const float* x1 = boxes.x1.data();
+    const float* y1 = boxes.y1.data();
+
+    std::vector<float> area(size);
+    for(int i=0;i<size;i++) area[i] = boxes.area(i);
+    const float* a = area.data();
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        float* row = &iou[size_t(i)*size];
+#pragma omp simd
+        for(int j=0;j<size;j++){
+            const float w = std::max(0.0f, std::min(x1[i], x1[j]) - std::max(x0[i], x0[j]));
+            const float h = std::max(0.0f, std::min(y1[i], y1[j]) - std::max(y0[i], y0[j]));
+            const float overlap = w*h;
+            const float total = a[i] + a[j] - overlap;
+            row[j] = (0.0f<overlap) ? overlap/total : 0.0f;
+        }
+    }
+}
+
+// 重なっている組 (i < j) とそのIoU
+struct BoxOverlap{
+    int i;
+    int j;
+    float iou;
+};
+
+// sweep and prune で重なる組だけを求める
+// x0 でソートし、x方向の区間が重なる相手だけを調べるので、
+// クラスタが画像全体に散らばっていれば N^2 の全組よりずっと少ない
+inline void overlapping_pairs(const ImageBoxes& boxes, std::vector<BoxOverlap>& pairs)
+{
+    const int size = boxes.size();
+    pairs.clear();
+
+    std::vector<int> order(size);
+    for(int i=0;i<size;i++) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b){ return boxes.x0[a]<boxes.x0[b]; });
+
+    for(int s=0;s<size;s++){
+        const int i = order[s];
+        const float area_i = boxes.area(i);
+        if(area_i<=0.0f) continue;
+        for(int t=s+1;t<size && boxes.x0[order[t]]<boxes.x1[i];t++){
+            const int j = order[t];
+            const float w = std::min(boxes.x1[i], boxes.x1[j]) - boxes.x0[j];
+            const float h = std::min(boxes.y1[i], boxes.y1[j]) - std::max(boxes.y0[i], boxes.y0[j]);
+            if(w<=0.0f || h<=0.0f) continue;
+            const float overlap = w*h;
+            BoxOverlap pair;
+            pair.i = std::min(i, j);
+            pair.j = std::max(i, j);
+            pair.iou = overlap/(area_i + boxes.area(j) - overlap);
+            pairs.push_back(pair);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _CAMERA_DOWNSAMPLE_H_
+#define _CAMERA_DOWNSAMPLE_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl_ros/point_cloud.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/voxel_filter.h>
+
+// カメラ点群をボクセルの重心でダウンサンプリングする (RGBも平均される)
+// node(src/camera_downsample.cpp) と nodelet(src/nodelet/sensor_fusion_nodelets.cpp) で共通
+class CameraDownsample{
+    private:
+        typedef pcl::PointXYZRGB PointT;
+        typedef pcl::PointCloud<PointT> Cloud;
+
+        ros::Subscriber sub;
+        ros::Publisher pub_ds_cloud;
+
+        double ds_size;
+
+        // 呼び出しごとに再確保しないよう保持しておく
+        Cloud::Ptr cloud;
+        VoxelFilter<PointT> sor;
+
+    public:
+        CameraDownsample(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+        void pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg);
+};
+
+CameraDownsample::CameraDownsample(ros::NodeHandle nh, ros::NodeHandle pnh)
+    : ds_size(0.03), cloud(new Cloud)
+{
+    pnh.getParam("ds_size", ds_size);
+
+    sub = nh.subscribe("/cloud", 10, &CameraDownsample::pcCallback, this);
+    pub_ds_cloud = nh.advertise<sensor_msgs::PointCloud2>("/output", 10);
+}
+
+void CameraDownsample::pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+    pcl::fromROSMsg(*msg, *cloud);
+
+    Cloud ds_cloud;
+    sor.setLeafSize (ds_size);
+    sor.filter (*cloud, ds_cloud);
+
+    sensor_msgs::PointCloud2Ptr output(new sensor_msgs::PointCloud2);
+    pcl::toROSMsg(ds_cloud, *output);
+    output->header.stamp = ros::Time::now();
+    output->header.frame_id = msg->header.frame_id;
+    pub_ds_cloud.publish(output);
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef _CLUSTER_STATS_H_
+#define _CLUSTER_STATS_H_
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/Cluster.h>
+#include <sensor_fusion/normal_estimation.h>
+
+#include <vector>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "Eigen/Core"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// クラスタの統計量(重心, AABB, 共分散, 曲率)
+// クラスタリング結果のindexリストから直接求めるので、クラスタごとに点群をコピーしない
+struct ClusterStats{
+    int size;
+    Eigen::Vector3f centroid;
+    Eigen::Vector3f min_p;
+    Eigen::Vector3f max_p;
+    Eigen::Matrix3f covariance;
+    float curvature;            // 最小固有値 / 固有値の和 (normal_from_moments() と同じ定義)
+
+    float depth()  const { return max_p[0]-min_p[0]; }   // x方向
+    float width()  const { return max_p[1]-min_p[1]; }   // y方向
+    float height() const { return max_p[2]-min_p[2]; }   // z方向
+};
+
+// 1パスで統計量を集める
+// 和と二乗和は最初の点からの差をdoubleで足すので、原点から遠い点群でも共分散の桁落ちが起きない
+class ClusterStatsAccumulator{
+    private:
+        int n;
+        Eigen::Vector3d origin;
+        Eigen::Vector3d sum;
+        Eigen::Matrix3d sum_sq;
+        Eigen::Vector3f min_p;
+        Eigen::Vector3f max_p;
+
+    public:
+        ClusterStatsAccumulator()
+            : n(0), origin(Eigen::Vector3d::Zero()), sum(Eigen::Vector3d::Zero()), sum_sq(Eigen::Matrix3d::Zero())
+        {
+            min_p.setConstant( std::numeric_limits<float>::max());
+            max_p.setConstant(-std::numeric_limits<float>::max());
+        }
+
+        // 差を取る基準点 (add より前に一度だけ呼ぶ)
+        void setOrigin(const Eigen::Vector3f& p){ origin = p.cast<double>(); }
+
+        void add(const Eigen::Vector3f& p)
+        {
+            const Eigen::Vector3d d = p.cast<double>() - origin;
+            n++;
+            sum += d;
+            sum_sq.noalias() += d*d.transpose();
+            min_p = min_p.cwiseMin(p);
+            max_p = max_p.cwiseMax(p);
+        }
+
+        // 同じ origin の別の集計を合わせる
+        void merge(const ClusterStatsAccumulator& other)
+        {
+            n += other.n;
+            sum += other.sum;
+            sum_sq += other.sum_sq;
+            min_p = min_p.cwiseMin(other.min_p);
+            max_p = max_p.cwiseMax(other.max_p);
+        }
+
+        void finish(ClusterStats& stats) const
+        {
+            stats.size = n;
+            stats.min_p = min_p;
+            stats.max_p = max_p;
+            if(n==0){
+                stats.centroid.setZero();
+                stats.covariance.setZero();
+                stats.curvature = 0.0f;
+                return;
+            }
+
+            const Eigen::Vector3d mean = sum/n;
+            const Eigen::Matrix3d cov = sum_sq/n - mean*mean.transpose();
+            stats.centroid = (origin + mean).cast<float>();
+            stats.covariance = cov.cast<float>();
+
+            // 曲率の定義は法線推定と同じ (法線は使わない)
+            Eigen::Vector3f normal;
+            normal_from_moments(n, sum, sum_sq, Eigen::Vector3f::Zero(), normal, stats.curvature);
+        }
+};
+
+// 1つのクラスタの統計量 (点について並列に集計する)
+template<typename PointT>
+void compute_cluster_stats(const pcl::PointCloud<PointT>& cloud,
+                           const std::vector<int>& indices,
+                           ClusterStats& stats)
+{
+    const int size = int(indices.size());
+    ClusterStatsAccumulator total;
+    if(0<size){
+        const PointT& p0 = cloud.points[indices[0]];
+        total.setOrigin(Eigen::Vector3f(p0.x, p0.y, p0.z));
+    }
+    const ClusterStatsAccumulator initial = total;
+
+#pragma omp parallel
+    {
+        ClusterStatsAccumulator local = initial;
+#pragma omp for schedule(static) nowait
+        for(int i=0;i<size;i++){
+            const PointT& p = cloud.points[indices[i]];
+            local.add(Eigen::Vector3f(p.x, p.y, p.z));
+        }
+#pragma omp critical
+        total.merge(local);
+    }
+    total.finish(stats);
+}
+
+// 点群全体の統計量
+template<typename PointT>
+void compute_cluster_stats(const pcl::PointCloud<PointT>& cloud, ClusterStats& stats)
+{
+    const int size = int(cloud.points.size());
+    ClusterStatsAccumulator total;
+    if(0<size)
+        total.setOrigin(Eigen::Vector3f(cloud.points[0].x, cloud.points[0].y, cloud.points[0].z));
+    const ClusterStatsAccumulator initial = total;
+
+#pragma omp parallel
+    {
+        ClusterStatsAccumulator local = initial;
+#pragma omp for schedule(static) nowait
+        for(int i=0;i<size;i++){
+            const PointT& p = cloud.points[i];
+            local.add(Eigen::Vector3f(p.x, p.y, p.z));
+        }
+#pragma omp critical
+        total.merge(local);
+    }
+    total.finish(stats);
+}
+
+// 全クラスタの統計量 (クラスタについて並列に集計する)
+// クラスタの点数は偏るので dynamic で割り当てる
+template<typename PointT>
+void compute_cluster_stats(const pcl::PointCloud<PointT>& cloud,
+                           const std::vector<std::vector<int> >& clusters,
+                           std::vector<ClusterStats>& stats)
+{
+    const int num_clusters = int(clusters.size());
+    stats.resize(num_clusters);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int k=0;k<num_clusters;k++){
+        const std::vector<int>& indices = clusters[k];
+        ClusterStatsAccumulator acc;
+        if(!indices.empty()){
+            const PointT& p0 = cloud.points[indices[0]];
+            acc.setOrigin(Eigen::Vector3f(p0.x, p0.y, p0.z));
+        }
+        for(size_t i=0;i<indices.size();i++){
+            const PointT& p = cloud.points[indices[i]];
+            acc.add(Eigen::Vector3f(p.x, p.y, p.z));
+        }
+        acc.finish(stats[k]);
+    }
+}
+
+// 統計量をクラスタ情報の構造体に移す
+// ClusterT は x,y,z (重心), width,height,depth, curvature, min_p,max_p を持つもの
+// (clustering.h, get_cluster_info.h, depthimage_creater.h の Cluster)
+template<typename ClusterT>
+inline void copy_cluster_stats(const ClusterStats& stats, ClusterT& cluster)
+{
+    cluster.x = stats.centroid[0];
+    cluster.y = stats.centroid[1];
+    cluster.z = stats.centroid[2];
+    cluster.depth  = stats.depth();
+    cluster.width  = stats.width();
+    cluster.height = stats.height();
+    cluster.curvature = stats.curvature;
+    cluster.min_p = stats.min_p;
+    cluster.max_p = stats.max_p;
+}
+
+// indices の点の x,y,z だけを PointCloud2 に書き込む
+// pcl::PointCloud を作ってから toROSMsg で変換する二重のコピーを避ける
+template<typename PointT>
+void indices_to_pointcloud2(const pcl::PointCloud<PointT>& cloud,
+                            const std::vector<int>& indices,
+                            sensor_msgs::PointCloud2& msg)
+{
+    const int size = int(indices.size());
+
+    msg.fields.resize(3);
+    const char* names[3] = {"x", "y", "z"};
+    for(int f=0;f<3;f++){
+        msg.fields[f].name = names[f];
+        msg.fields[f].offset = 4*f;
+        msg.fields[f].datatype = sensor_msgs::PointField::FLOAT32;
+        msg.fields[f].count = 1;
+    }
+    msg.height = 1;
+    msg.width = size;
+    msg.is_bigendian = false;
+    msg.point_step = 3*sizeof(float);
+    msg.row_step = msg.point_step*size;
+    msg.is_dense = false;
+    msg.data.resize(msg.row_step);
+
+    uint8_t* data = msg.data.data();
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud.points[indices[i]];
+        const float xyz[3] = {p.x, p.y, p.z};
+        std::memcpy(data + size_t(i)*3*sizeof(float), xyz, sizeof(xyz));
+    }
+}
+
+// 統計量とクラスタの点を sensor_fusion/Cluster メッセージに詰める
+// centroid は重心1点, points はクラスタの点 (x,y,z のみ)
+template<typename PointT>
+void to_cluster_msg(const pcl::PointCloud<PointT>& cloud,
+                    const std::vector<int>& indices,
+                    const ClusterStats& stats,
+                    sensor_fusion::Cluster& msg)
+{
+    msg.width = stats.width();
+    msg.height = stats.height();
+    msg.depth = stats.depth();
+    msg.curvature = stats.curvature;
+
+    pcl::PointCloud<pcl::PointXYZ> centroid;
+    centroid.points.resize(1);
+    centroid.points[0].x = stats.centroid[0];
+    centroid.points[0].y = stats.centroid[1];
+    centroid.points[0].z = stats.centroid[2];
+    std::vector<int> first(1, 0);
+    indices_to_pointcloud2(centroid, first, msg.centroid);
+
+    indices_to_pointcloud2(cloud, indices, msg.points);
+}
+
+#endif
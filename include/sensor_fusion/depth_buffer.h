@@ -0,0 +1,83 @@
+#ifndef _DEPTH_BUFFER_H_
+#define _DEPTH_BUFFER_H_
+
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+// 画素ごとに最も近い点の距離を保持するZバッファ
+// 点群を距離順にソートしなくても、各点を1回書き込むだけで手前の点が残るので O(点数) で深度画像が作れる
+//
+// 各画素は (距離のfloatのbit列 << 32 | id) の64bit値で持ち、atomicな最小値更新で書き込む
+// 非負のfloatはbit列を符号なし整数として比較しても大小関係が変わらないので、
+// 複数スレッドから同時に書き込んでも最も近い点が残り、距離が同じ場合はidが小さい方が残る
+class DepthBuffer{
+    private:
+        int width;
+        int height;
+        std::vector<uint64_t> cell;
+
+        static uint64_t empty() { return ~uint64_t(0); }
+
+        static uint64_t pack(float depth, uint32_t id)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &depth, sizeof(bits));
+            return (uint64_t(bits) << 32) | id;
+        }
+
+    public:
+        DepthBuffer()
+            : width(0), height(0) {}
+
+        DepthBuffer(int width_, int height_)
+        {
+            reset(width_, height_);
+        }
+
+        // 全画素を空にする(サイズが同じなら確保し直さない)
+        void reset(int width_, int height_)
+        {
+            width = width_;
+            height = height_;
+            cell.assign(size_t(width)*height, empty());
+        }
+
+        int cols() const { return width; }
+        int rows() const { return height; }
+
+        // 画素(x, y)に距離depth, id の点を書き込む (depth >= 0)
+        void write(int x, int y, float depth, uint32_t id = 0)
+        {
+            if(x<0 || width<=x || y<0 || height<=y) return;
+
+            uint64_t* p = &cell[size_t(y)*width + x];
+            const uint64_t key = pack(depth, id);
+            uint64_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+            while(key<old && !__atomic_compare_exchange_n(p, &old, key, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){}
+        }
+
+        // 画素位置(u, v)を中心とした (2*radius+1) x (2*radius+1) の範囲に書き込む
+        void splat(float u, float v, float depth, uint32_t id = 0, int radius = 1)
+        {
+            const int cx = int(u);
+            const int cy = int(v);
+            for(int j=-radius;j<=radius;j++)
+                for(int i=-radius;i<=radius;i++)
+                    write(cx+i, cy+j, depth, id);
+        }
+
+        bool valid(int x, int y) const { return cell[size_t(y)*width + x]!=empty(); }
+
+        float depth(int x, int y) const
+        {
+            const uint32_t bits = uint32_t(cell[size_t(y)*width + x] >> 32);
+            float d;
+            std::memcpy(&d, &bits, sizeof(d));
+            return d;
+        }
+
+        uint32_t id(int x, int y) const { return uint32_t(cell[size_t(y)*width + x]); }
+};
+
+#endif
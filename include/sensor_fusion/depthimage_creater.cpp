@@ -73,7 +73,7 @@ void DepthImage::nodeCallback(const sensor_fusion::NodeConstPtr msg)
     cout<<"----zed0"<<endl;
     depthimage_creater(zed0_cloud_obstacle, zed0_cloud_ground,
                        zed0_image, zed0_cinfo, zed0_frame,
-                       zed0_pub, zed0_raw_pub, zed0_cluster_pub, zed0_cloud_pub);
+                       zed0_pub, zed0_instance_pub, zed0_raw_pub, zed0_cluster_pub, zed0_cloud_pub);
     
     // cout<<"----zed1"<<endl;
     // depthimage_creater(zed1_cloud, zed1_image, zed1_cinfo, zed1_frame, zed1_pub, zed1_raw_pub, zed1_cluster_pub, zed1_cloud_pub);
@@ -113,6 +113,7 @@ void DepthImage::depthimage_creater(CloudAPtr obstacle_cloud,
                                     sensor_msgs::CameraInfoConstPtr cinfo_msg,
                                     string target_frame,
                                     image_transport::Publisher image_pub,
+                                    image_transport::Publisher instance_pub,
                                     ros::Publisher image_raw_pub,
                                     ros::Publisher cluster_pub,
                                     ros::Publisher cloud_pub)
@@ -140,31 +141,19 @@ void DepthImage::depthimage_creater(CloudAPtr obstacle_cloud,
     cv::Mat image(cv_img_ptr->image.rows, cv_img_ptr->image.cols, cv_img_ptr->image.type());
     image = cv_bridge::toCvShare(image_msg)->image;
 
-    image_geometry::PinholeCameraModel cam_model;
-    cam_model.fromCameraInfo(cinfo_msg);
-
     // カメラの画角内の点群を参照点として取得
-    for(pcl::PointCloud<pcl::PointXYZRGBNormal>::iterator pt=obstacle_cloud->points.begin(); pt<obstacle_cloud->points.end(); pt++)
-    {
-        if ((*pt).x<0) continue;
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
+    // カリングと同じパスで画角内の点の座標をSoACloudに取り出し、色などは元の点群からコピーする
+    const Eigen::Matrix<float, 3, 4> projection = laser_to_image_projection(*cinfo_msg);
 
-        if(uv.x>0 && uv.x < image.cols && uv.y > 0 && uv.y < image.rows)
-            reference_obstacle_cloud->points.push_back(*pt);
-    }
+    vector<int> obstacle_indices;
+    vector<int> ground_indices;
+    SoACloud reference_obstacle_soa;
+    SoACloud reference_ground_soa;
+    frustum_cull(*obstacle_cloud, projection, image.cols, image.rows, 0.0f, numeric_limits<float>::max(), obstacle_indices, reference_obstacle_soa);
+    frustum_cull(*ground_cloud,   projection, image.cols, image.rows, 0.0f, numeric_limits<float>::max(), ground_indices,   reference_ground_soa);
 
-    for(pcl::PointCloud<pcl::PointXYZRGBNormal>::iterator pt=ground_cloud->points.begin(); pt<ground_cloud->points.end(); pt++)
-    {
-        if ((*pt).x<0) continue;
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
-
-        if(uv.x>0 && uv.x < image.cols && uv.y > 0 && uv.y < image.rows)
-            reference_ground_cloud->points.push_back(*pt);
-    }
+    copy_points(*obstacle_cloud, obstacle_indices, *reference_obstacle_cloud);
+    copy_points(*ground_cloud,   ground_indices,   *reference_ground_cloud);
 
     // 参照点群を可視化
     // *reference_cloud += *reference_obstacle_cloud;
@@ -247,110 +236,47 @@ void DepthImage::depthimage_creater(CloudAPtr obstacle_cloud,
     }
 }}}*/
  
-    double distance[cv_img_ptr->image.rows][cv_img_ptr->image.cols];
-    bool obstacle_init[cv_img_ptr->image.rows][cv_img_ptr->image.cols];
-    bool ground_init[cv_img_ptr->image.rows][cv_img_ptr->image.cols];
-
-    memset(&distance, 0, cv_img_ptr->image.rows*cv_img_ptr->image.cols);
-    memset(&obstacle_init, false, cv_img_ptr->image.rows*cv_img_ptr->image.cols);
-    memset(&ground_init, false, cv_img_ptr->image.rows*cv_img_ptr->image.cols);
-
-#pragma omp parallel for
-    for(pcl::PointCloud<pcl::PointXYZRGBNormal>::iterator pt=reference_obstacle_cloud->points.begin(); pt<reference_obstacle_cloud->points.end(); pt++)
-    {
-        double range = sqrt( pow((*pt).x, 2.0) + pow((*pt).y, 2.0) + pow((*pt).z, 2.0));
-
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
-        
-        for(int i=-1;i<=1;i++){
-            for(int j=-1;j<=1;j++){
-                int x = uv.x + i;
-                int y = uv.y + j;
-                if(0<x && x<image.cols && 0<y && y<image.rows)
-                {
-                    if(!obstacle_init[y][x])
-                    {
-                        distance[y][x] = range; 
-                        obstacle_init[y][x] = true;
-                    }   
-                    else{
-                        if(range<distance[y][x])
-                            distance[y][x] = range;
-                    }
-                }
-            }
-        }
-
-        /*{{{
-        int x = uv.x;
-        int y = uv.y;
-
-        if(!obstacle_init[y][x])
-        {
-            distance[y][x] = range; 
-            obstacle_init[y][x] = true;
-        }   
-        else{
-            if(range<distance[y][x])
-                distance[y][x] = range;
-        }
-        }}}*/
+    // 参照点の画素位置と距離
+    vector<float> obstacle_u, obstacle_v, obstacle_range;
+    vector<float> ground_u,   ground_v,   ground_range;
+    project_points(reference_obstacle_soa, projection, obstacle_u, obstacle_v, obstacle_range);
+    project_points(reference_ground_soa,   projection, ground_u,   ground_v,   ground_range);
+
+    // 障害物点のインスタンスID (0 : どのクラスタにも属さない)
+    // 購読されているときだけクラスタリングし、IDは深度と同じZバッファに書き込む
+    const bool publish_instance = 0<instance_pub.getNumSubscribers();
+    vector<int> instance;
+    if(publish_instance){
+        GridClustering ec(0.15, 100, 1000000);
+        vector<vector<int> > cluster_indices;
+        ec.extract(*reference_obstacle_cloud, cluster_indices);
+        instance = ec.labels();
     }
 
-#pragma omp parallel for
-    for(pcl::PointCloud<pcl::PointXYZRGBNormal>::iterator pt=reference_ground_cloud->points.begin(); pt<reference_ground_cloud->points.end(); pt++)
-    {
-        double range = sqrt( pow((*pt).x, 2.0) + pow((*pt).y, 2.0) + pow((*pt).z, 2.0));
+    // 障害物と地面は別々のバッファに書き、障害物が写っていない画素だけ地面を使う
+    obstacle_buffer.reset(image.cols, image.rows);
+    ground_buffer.reset(image.cols, image.rows);
 
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
-
-        for(int i=-1;i<=1;i++){
-            for(int j=-1;j<=1;j++){
-                int x = uv.x + i;
-                int y = uv.y + j;
-                if(0<x && x<image.cols && 0<y && y<image.rows)
-                {
-                    if(!obstacle_init[y][x])
-                    {
-                        if(!ground_init[y][x])
-                        {
-                            distance[y][x] = range;
-                            ground_init[y][x] = true;
-                        }
-                        else if(range<distance[y][x])
-                            distance[y][x] = range;
-                    }
-                }
-            }
-        }
-        
-        /*{{{
-        int x = uv.x;
-        int y = uv.y;
-
-        if(!obstacle_init[y][x])
-        {
-            if(!ground_init[y][x])
-            {
-                distance[y][x] = range;
-                ground_init[y][x] = true;
-            }
-            else if(range<distance[y][x])
-                distance[y][x] = range;
-        }
-        }}}*/
+#pragma omp parallel for schedule(static)
+    for(int n=0;n<reference_obstacle_soa.size();n++){
+        const uint32_t id = publish_instance ? uint32_t(instance[n]+1) : 0;
+        obstacle_buffer.splat(obstacle_u[n], obstacle_v[n], obstacle_range[n], id);
     }
 
+#pragma omp parallel for schedule(static)
+    for(int n=0;n<reference_ground_soa.size();n++)
+        ground_buffer.splat(ground_u[n], ground_v[n], ground_range[n]);
+
+    cv::Mat instance_image;
+    if(publish_instance)
+        instance_image = cv::Mat::zeros(image.rows, image.cols, CV_16UC1);
 
 #pragma omp parallel for
     for(int y=0; y<image.rows; y++){
         for(int x=0; x<image.cols; x++){
-            if(obstacle_init[y][x] || ground_init[y][x]){
-                double range = distance[y][x];
+            const bool obstacle = obstacle_buffer.valid(x, y);
+            if(obstacle || ground_buffer.valid(x, y)){
+                double range = obstacle ? obstacle_buffer.depth(x, y) : ground_buffer.depth(x, y);
                 COLOR c = GetColor(int(range/50*255.0), 0, 255);
                 image.at<cv::Vec3b>(y, x)[0] = 255*c.b;
                 image.at<cv::Vec3b>(y, x)[1] = 255*c.g;
@@ -361,6 +287,8 @@ void DepthImage::depthimage_creater(CloudAPtr obstacle_cloud,
                 image.at<cv::Vec3b>(y, x)[1] = 0;
                 image.at<cv::Vec3b>(y, x)[2] = 0;
             }
+            if(publish_instance && obstacle)
+                instance_image.at<uint16_t>(y, x) = uint16_t(min(obstacle_buffer.id(x, y), uint32_t(65535)));
         }
     }
 
@@ -373,6 +301,9 @@ void DepthImage::depthimage_creater(CloudAPtr obstacle_cloud,
     image_pub.publish(msg);
     // Publish Raw Image
     image_raw_pub.publish(tmp_image);
+    // Publish Instance Image (画素値 : クラスタ番号+1, 0 : 背景)
+    if(publish_instance)
+        instance_pub.publish(cv_bridge::CvImage(image_msg->header, "mono16", instance_image).toImageMsg());
 }
 
 void DepthImage::LocalCloud(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud,
@@ -406,219 +337,88 @@ void DepthImage::inverseCloud(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud
         <<" x:"<<x<<" y:"<<y<<" z:"<<z<<" roll:"<<roll<<" pitch:"<<pitch<<" yaw:"<<yaw<<endl;
 }
 
-// PointCloudの情報をClusterに格納
-void DepthImage::getClusterInfo(CloudA pt,
-                                Cluster& cluster)
-{
-    Vector3f centroid;
-    centroid[0]=pt.points[0].x;
-    centroid[1]=pt.points[0].y;
-    centroid[2]=pt.points[0].z;
-
-    Vector3f min_p;
-    min_p[0]=pt.points[0].x;
-    min_p[1]=pt.points[0].y;
-    min_p[2]=pt.points[0].z;
-
-    Vector3f max_p;
-    max_p[0]=pt.points[0].x;
-    max_p[1]=pt.points[0].y;
-    max_p[2]=pt.points[0].z;
-
-    for(size_t i=1;i<pt.points.size();i++){
-        centroid[0]+=pt.points[i].x;
-        centroid[1]+=pt.points[i].y;
-        centroid[2]+=pt.points[i].z;
-        if (pt.points[i].x<min_p[0]) min_p[0]=pt.points[i].x;
-        if (pt.points[i].y<min_p[1]) min_p[1]=pt.points[i].y;
-        if (pt.points[i].z<min_p[2]) min_p[2]=pt.points[i].z;
-
-        if (pt.points[i].x>max_p[0]) max_p[0]=pt.points[i].x;
-        if (pt.points[i].y>max_p[1]) max_p[1]=pt.points[i].y;
-        if (pt.points[i].z>max_p[2]) max_p[2]=pt.points[i].z;
-    }
-
-    cluster.x=centroid[0]/(float)pt.points.size();
-    cluster.y=centroid[1]/(float)pt.points.size();
-    cluster.z=centroid[2]/(float)pt.points.size();
-    cluster.depth  = max_p[0]-min_p[0];
-    cluster.width  = max_p[1]-min_p[1];
-    cluster.height = max_p[2]-min_p[2]; 
-    cluster.min_p = min_p;
-    cluster.max_p = max_p;
-}
-
 // Clustering
 void DepthImage::clustering(CloudAPtr cloud_in,
                             vector<Clusters>& cluster_array){
     //Downsample//
-    pcl::VoxelGrid<PointA> vg;  
+    VoxelFilter<PointA> vg;
     CloudAPtr ds_cloud (new CloudA);  
-    vg.setInputCloud (cloud_in);  
-    vg.setLeafSize (0.1f, 0.1f, 0.1f);
-    vg.filter (*ds_cloud);
+    vg.setLeafSize (0.1f);
+    vg.filter (*cloud_in, *ds_cloud);
     cout<<"----DownSampling:"<<ds_cloud->points.size()<<endl;
 
-    //downsampled point's z =>0
-    vector<float> tmp_z;
-    tmp_z.resize(ds_cloud->points.size());
-	for(int i=0;i<(int)ds_cloud->points.size();i++){
-        tmp_z[i]=ds_cloud->points[i].z;
-		ds_cloud->points[i].z  = 0.0;
-    }
     //Clustering//
-    pcl::search::KdTree<PointA>::Ptr tree (new pcl::search::KdTree<PointA>);
-    tree->setInputCloud (ds_cloud);
-    std::vector<pcl::PointIndices> cluster_indices;
-    pcl::EuclideanClusterExtraction<PointA> ec;
-    ec.setClusterTolerance (0.15); // 15cm
-    ec.setMinClusterSize (100);
-    ec.setMaxClusterSize (1000000);
-    ec.setSearchMethod (tree);
-    ec.setInputCloud(ds_cloud);
-    ec.extract (cluster_indices);
-    //reset z value
-	for(int i=0;i<(int)ds_cloud->points.size();i++)
-        ds_cloud->points[i].z=tmp_z[i];
-
-    for(int iii=0;iii<(int)cluster_indices.size();iii++)
+    // x-y平面で距離が tolerance 以内の点をつなぐ(zは無視される)
+    GridClustering ec(0.15, 100, 1000000);
+    vector<vector<int> > cluster_indices;
+    ec.extract(*ds_cloud, cluster_indices);
+
+    vector<ClusterStats> stats;
+    compute_cluster_stats(*ds_cloud, cluster_indices, stats);
+
+    // 各クラスタの点は出力先に直接1回だけコピーする
+    const size_t offset = cluster_array.size();
+    cluster_array.resize(offset + cluster_indices.size());
+    for(size_t k=0;k<cluster_indices.size();k++)
     {
-        // cluster points
-        CloudAPtr cloud_cluster (new CloudA);
-        cloud_cluster->points.resize(cluster_indices[iii].indices.size());
-        // cluster data
-        Cluster data;
-        for(int jjj=0;jjj<int(cluster_indices[iii].indices.size());jjj++){
-            int p_num = cluster_indices[iii].indices[jjj];
-            cloud_cluster->points[jjj] = ds_cloud->points[p_num];
-        }
-        getClusterInfo(*cloud_cluster, data);
+        Clusters& cluster = cluster_array[offset+k];
+        copy_points(*ds_cloud, cluster_indices[k], cluster.points);
+        copy_cluster_stats(stats[k], cluster.data);
 
 		PointA center;
-		center.x = data.x;
-		center.y = data.y;
-		center.z = data.z;
-
-        Clusters cluster;
-        cluster.data = data;
+		center.x = cluster.data.x;
+		center.y = cluster.data.y;
+		center.z = cluster.data.z;
         cluster.centroid.points.push_back(center);
-        for(size_t i=0;i<cloud_cluster->points.size();i++)
-            cluster.points.points.push_back(cloud_cluster->points[i]);
-
-        cluster_array.push_back(cluster);
     }
     cout<<"----Clustering:"<<cluster_array.size()<<endl;
 }
 
 // 各クラスタのIOUを計算
-void DepthImage::iou(vector<Clusters> cluster_array,
+void DepthImage::iou(const vector<Clusters>& cluster_array,
                      sensor_msgs::CameraInfoConstPtr cinfo_msg,
                      CloudAPtr& cloud)
 {
+    const int size = int(cluster_array.size());
 
-    vector<Clusters> clusters = cluster_array;
-    int id[int(clusters.size())]={};
-    double distance[int(clusters.size())] = {};
+    // 各クラスタの重心点の距離
+    vector<double> distance(size);
+    for(int i=0;i<size;i++)
+        distance[i] = sqrt(pow(cluster_array[i].data.x, 2)+pow(cluster_array[i].data.y, 2));
 
-    // 各クラスタの重心点の距離をidとdistanceに保存
-    for(int i=0;i<int(clusters.size());i++)
-    {
-        id[i] = i;
-        distance[i] = sqrt(pow(clusters[i].data.x, 2)+pow(clusters[i].data.y, 2));
-    }
+    // クラスタを距離が近い順に並び替え (クラスタ自体は動かさずindexだけ並べる)
+    vector<int> id(size);
+    for(int i=0;i<size;i++) id[i] = i;
+    stable_sort(id.begin(), id.end(), [&](int a, int b){ return distance[a]<distance[b]; });
 
-    // クラスタを距離が近い順に並び替え
-    for(int i=0;i<int(clusters.size());i++){
-        for(int j=i+1;j<int(clusters.size());j++){
-            if(distance[i] > distance[j]){
-                int tmp = id[i];
-                id[i] = id[j];
-                id[j] = tmp;
-
-                double tmp_dis = distance[i];
-                distance[i] = distance[j];
-                distance[j] = tmp_dis;
-
-                Clusters tmp_cls = clusters[i];
-                clusters[i] = clusters[j];
-                clusters[j] = tmp_cls;
-            }
-        }
-    }
-
-    for(int i=0;i<int(clusters.size());i++)
+    vector<Vector3f> min_p(size), max_p(size);
+    for(int i=0;i<size;i++){
+        const Cluster& data = cluster_array[id[i]].data;
         printf("    ID:%2d x:%.2f y:%.2f z:%.2f W:%.2f H:%.2f D:%.2f Distance:%.2f min:%.2f %.2f %.2f max:%.2f %.2f %.2f\n", 
-               i, clusters[i].data.x, clusters[i].data.y, clusters[i].data.z, 
-               clusters[i].data.width,    clusters[i].data.height,   clusters[i].data.depth, distance[i], 
-               clusters[i].data.min_p[0], clusters[i].data.min_p[1], clusters[i].data.min_p[2],
-               clusters[i].data.max_p[0], clusters[i].data.max_p[1], clusters[i].data.max_p[2]);
-
-    double iou[int(clusters.size())][int(clusters.size())] = {};
-    memset(&iou, 0, clusters.size()*clusters.size());
-
-    image_geometry::PinholeCameraModel cam_model;
-    cam_model.fromCameraInfo(cinfo_msg);
-
-    for(int i=0;i<int(clusters.size());i++){
-        cv::Point3d cv_min(-clusters[i].data.min_p[1], -clusters[i].data.min_p[2], clusters[i].data.min_p[0]);
-        cv::Point3d cv_max(-clusters[i].data.max_p[1], -clusters[i].data.max_p[2], clusters[i].data.max_p[0]);
-
-        cv::Point2d uv_min = cam_model.project3dToPixel(cv_min);
-        cv::Point2d uv_max = cam_model.project3dToPixel(cv_max);
-
-        printf("%.2f %.2f %.2f %.2f \n", uv_min.x, uv_min.y, uv_max.x, uv_max.y);
+               i, data.x, data.y, data.z, 
+               data.width,    data.height,   data.depth, distance[id[i]], 
+               data.min_p[0], data.min_p[1], data.min_p[2],
+               data.max_p[0], data.max_p[1], data.max_p[2]);
+        min_p[i] = data.min_p;
+        max_p[i] = data.max_p;
     }
 
+    // AABBを1回だけ画像に投影する
+    const Eigen::Matrix<float, 3, 4> projection = laser_to_image_projection(*cinfo_msg);
+    ImageBoxes boxes;
+    project_boxes(min_p, max_p, projection, cinfo_msg->width, cinfo_msg->height, 0.0f, boxes);
 
-    for(int i=0;i<int(clusters.size());i++){
-        for(int j=0;j<int(clusters.size());j++){
-            cv::Point3d cv_i_min(-clusters[i].data.min_p[1], -clusters[i].data.min_p[2], clusters[i].data.min_p[0]);
-            cv::Point3d cv_i_max(-clusters[i].data.max_p[1], -clusters[i].data.max_p[2], clusters[i].data.max_p[0]);
-            cv::Point3d cv_j_min(-clusters[j].data.min_p[1], -clusters[j].data.min_p[2], clusters[j].data.min_p[0]);
-            cv::Point3d cv_j_max(-clusters[j].data.max_p[1], -clusters[j].data.max_p[2], clusters[j].data.max_p[0]);
-
-            cv::Point2d uv_i_min = cam_model.project3dToPixel(cv_i_min);
-            cv::Point2d uv_i_max = cam_model.project3dToPixel(cv_i_max);
-            cv::Point2d uv_j_min = cam_model.project3dToPixel(cv_j_min);
-            cv::Point2d uv_j_max = cam_model.project3dToPixel(cv_j_max);
-
-            ROI ROI_I, ROI_J;
+    for(int i=0;i<size;i++)
+        printf("%.2f %.2f %.2f %.2f \n", boxes.x0[i], boxes.y0[i], boxes.x1[i], boxes.y1[i]);
 
-            ROI_I.x_offset = uv_i_min.x;
-            ROI_I.y_offset = uv_i_min.y;
-            ROI_I.width    = uv_i_max.x - uv_i_min.x;
-            ROI_I.height   = uv_i_max.y - uv_i_max.y;
+    vector<float> iou;
+    iou_matrix(boxes, iou);
 
-            ROI_J.x_offset = uv_j_min.x;
-            ROI_J.y_offset = uv_j_min.y;
-            ROI_J.width    = uv_j_max.x - uv_j_min.x;
-            ROI_J.height   = uv_j_max.y - uv_j_max.y;
-
-            // printf("I:%d %.2f %.2f %.2f %.2f\n", i, ROI_I.x_offset, ROI_I.y_offset, ROI_I.width, ROI_I.height);
-            // printf("J:%d %.2f %.2f %.2f %.2f\n", j, ROI_J.x_offset, ROI_J.y_offset, ROI_J.width, ROI_J.height);
-
-            cv::Rect RECT_I(ROI_I.x_offset, ROI_I.y_offset, ROI_I.width, ROI_I.height);
-            cv::Rect RECT_J(ROI_J.x_offset, ROI_J.y_offset, ROI_J.width, ROI_J.height);
-
-            cv::Rect RECT_OVERLAP = RECT_I & RECT_J;
-
-            int AREA_I          = RECT_I.width * RECT_I.height;
-            int AREA_J          = RECT_J.width * RECT_J.height;
-            int AREA_OVERLAP    = RECT_OVERLAP.width * RECT_OVERLAP.height;
-            
-            if(0.0<AREA_OVERLAP){
-                int AREA_UNION = AREA_I + AREA_J - AREA_OVERLAP;
-                iou[i][j] = AREA_OVERLAP / AREA_UNION;
-            }
-        }
-    }
-    for(int i=0;i<int(clusters.size());i++){
-        for(int j=0;j<int(clusters.size());j++)
-            printf("%.2f ", iou[i][j]);
+    for(int i=0;i<size;i++){
+        for(int j=0;j<size;j++)
+            printf("%.2f ", iou[i*size+j]);
         printf("\n");
     }
-
-
 }
 
 
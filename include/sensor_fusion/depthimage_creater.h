@@ -40,10 +40,17 @@
 #include <tf/transform_listener.h>
 
 #include <sensor_fusion/Node.h>
+#include <sensor_fusion/soa_cloud.h>
+#include <sensor_fusion/grid_clustering.h>
+#include <sensor_fusion/cluster_stats.h>
+#include <sensor_fusion/box_overlap.h>
+#include <sensor_fusion/depth_buffer.h>
+#include <sensor_fusion/voxel_filter.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <iostream>
+#include <limits>
 
 #include "Eigen/Core"
 #include "Eigen/Dense"
@@ -104,6 +111,10 @@ class DepthImage{
         image_transport::Publisher zed1_pub;
         image_transport::Publisher zed2_pub;
 
+        image_transport::Publisher zed0_instance_pub;
+        image_transport::Publisher zed1_instance_pub;
+        image_transport::Publisher zed2_instance_pub;
+
         ros::Publisher zed0_raw_pub;
         ros::Publisher zed1_raw_pub;
         ros::Publisher zed2_raw_pub;
@@ -143,6 +154,10 @@ class DepthImage{
         int grid_dimentions;
         double height_threshold;
 
+        // depth image
+        DepthBuffer obstacle_buffer;
+        DepthBuffer ground_buffer;
+
     public:
         DepthImage();
 
@@ -160,6 +175,7 @@ class DepthImage{
                                 sensor_msgs::CameraInfoConstPtr cinfo_msg,
                                 string target_frame,
                                 image_transport::Publisher image_pub,
+                                image_transport::Publisher instance_pub,
                                 ros::Publisher image_raw_pub,
                                 ros::Publisher cluster_pub,
                                 ros::Publisher cloud_pub);
@@ -171,13 +187,10 @@ class DepthImage{
                           pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& inverse_cloud,
                           tf::Transform transform);
 
-        void getClusterInfo(CloudA cloud,
-                            Cluster& cluster);
-
         void clustering(CloudAPtr cloud,
                         vector<Clusters>& cluster_array);
 
-        void iou(vector<Clusters> cluster_array,
+        void iou(const vector<Clusters>& cluster_array,
                  sensor_msgs::CameraInfoConstPtr cinfo_msg,
                  CloudAPtr& cloud);
 
@@ -216,6 +229,10 @@ DepthImage::DepthImage()
     zed0_pub = it.advertise("/zed0_depthimage", 10);
     zed1_pub = it.advertise("/zed1_depthimage", 10);
     zed2_pub = it.advertise("/zed2_depthimage", 10);
+
+    zed0_instance_pub = it.advertise("/zed0_instance", 10);
+    zed1_instance_pub = it.advertise("/zed1_instance", 10);
+    zed2_instance_pub = it.advertise("/zed2_instance", 10);
     
     zed0_raw_pub = nh.advertise<sensor_msgs::Image>("/zed0_raw", 10);
     zed1_raw_pub = nh.advertise<sensor_msgs::Image>("/zed1_raw", 10);
@@ -0,0 +1,210 @@
+#ifndef _DESKEW_H_
+#define _DESKEW_H_
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "Eigen/StdVector"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// SQ-LiDARは回転しながら1スキャンを取得するので、走行中は点ごとに取得時の姿勢が異なる
+// Odometry(またはtf)の姿勢をリングバッファに保存しておき、
+// 各点の時刻の姿勢を補間(回転はslerp, 並進は線形補間)して点を補正する
+//
+// スキャンを受け取った時点ではスキャン中の姿勢がまだ届いていないことが多いので、
+// 最新の姿勢より後の時刻は最後の2つの姿勢の速度で外挿する (max_extrapolation 秒まで)
+
+// 時刻付き姿勢のリングバッファ
+class PoseBuffer{
+    private:
+        std::vector<double> stamp;
+        std::vector<Eigen::Quaterniond, Eigen::aligned_allocator<Eigen::Quaterniond> > rotation;
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > translation;
+        int head;
+        int count;
+        double max_extrapolation;
+
+        int index(int i) const { return (head-count+i+capacity())%capacity(); }
+
+    public:
+        PoseBuffer(int size = 200)
+            : head(0), count(0), max_extrapolation(0.2)
+        {
+            setSize(size);
+        }
+
+        // 最新の姿勢からこの秒数までは外挿し、それより後は max_extrapolation 秒後の姿勢を使う (0 なら外挿しない)
+        void setMaxExtrapolation(double seconds){ max_extrapolation = seconds; }
+
+        void setSize(int size)
+        {
+            if(size<2) size = 2;
+            stamp.assign(size, 0.0);
+            rotation.assign(size, Eigen::Quaterniond::Identity());
+            translation.assign(size, Eigen::Vector3d::Zero());
+            head = 0;
+            count = 0;
+        }
+
+        int capacity() const { return int(stamp.size()); }
+        int size() const { return count; }
+        bool empty() const { return count==0; }
+
+        double oldest() const { return stamp[index(0)]; }
+        double latest() const { return stamp[index(count-1)]; }
+
+        // 時刻が戻った姿勢は無視する
+        void push(double t, const Eigen::Quaterniond& q, const Eigen::Vector3d& p)
+        {
+            if(0<count && t<=latest()) return;
+
+            stamp[head] = t;
+            rotation[head] = q.normalized();
+            translation[head] = p;
+            head = (head+1)%capacity();
+            if(count<capacity()) count++;
+        }
+
+        // 時刻tの姿勢を補間する
+        // 最古より前の時刻は最古の姿勢を使い、最新より後の時刻は外挿する
+        bool interpolate(double t, Eigen::Quaterniond& q, Eigen::Vector3d& p) const
+        {
+            if(empty()) return false;
+
+            if(t<=oldest()){
+                q = rotation[index(0)];
+                p = translation[index(0)];
+                return true;
+            }
+            if(latest()<=t){
+                const int i1 = index(count-1);
+                q = rotation[i1];
+                p = translation[i1];
+                if(count<2 || max_extrapolation<=0.0) return true;
+
+                // 最後の2つの姿勢の間の回転と並進が同じ速さで続くとする
+                const int i0 = index(count-2);
+                const double alpha = (std::min(t, latest()+max_extrapolation) - stamp[i1])/(stamp[i1]-stamp[i0]);
+                const Eigen::AngleAxisd delta(rotation[i0].conjugate()*rotation[i1]);
+                q = (rotation[i1]*Eigen::Quaterniond(Eigen::AngleAxisd(alpha*delta.angle(), delta.axis()))).normalized();
+                p = translation[i1] + alpha*(translation[i1]-translation[i0]);
+                return true;
+            }
+
+            // stamp[index(lo)] <= t < stamp[index(hi)] となる区間を二分探索
+            int lo = 0;
+            int hi = count-1;
+            while(1<hi-lo){
+                int mid = (lo+hi)/2;
+                if(stamp[index(mid)]<=t) lo = mid;
+                else hi = mid;
+            }
+            const int i0 = index(lo);
+            const int i1 = index(hi);
+            const double alpha = (t-stamp[i0])/(stamp[i1]-stamp[i0]);
+
+            q = rotation[i0].slerp(alpha, rotation[i1]);
+            p = translation[i0] + alpha*(translation[i1]-translation[i0]);
+            return true;
+        }
+
+        bool interpolate(double t, Eigen::Isometry3d& pose) const
+        {
+            Eigen::Quaterniond q;
+            Eigen::Vector3d p;
+            if(!interpolate(t, q, p)) return false;
+            pose.setIdentity();
+            pose.linear() = q.toRotationMatrix();
+            pose.translation() = p;
+            return true;
+        }
+};
+
+// 各点の取得時刻(header.stampからの経過秒)を取得する
+// "time"フィールドがあればそれを使い、なければ点が取得順に並んでいるとみなして
+// scan_period秒の間に等間隔で取得されたものとする
+inline void point_times(const sensor_msgs::PointCloud2& msg,
+                        double scan_period,
+                        std::vector<float>& times)
+{
+    const size_t size = size_t(msg.width)*msg.height;
+    times.resize(size);
+
+    for(size_t f=0;f<msg.fields.size();f++){
+        if(msg.fields[f].name=="time" && msg.fields[f].datatype==sensor_msgs::PointField::FLOAT32){
+            sensor_msgs::PointCloud2ConstIterator<float> it(msg, "time");
+            for(size_t i=0;i<size;i++, ++it)
+                times[i] = *it;
+            return;
+        }
+    }
+
+    const float dt = (1<size) ? float(scan_period/(size-1)) : 0.0f;
+    for(size_t i=0;i<size;i++)
+        times[i] = dt*i;
+}
+
+// 点iを時刻 stamp+times[i] のセンサ姿勢で変換し、reference座標系に移す
+// referenceにIdentityを渡すとPoseBufferの座標系(odomやglobal)での点群になる
+template<typename PointT>
+bool deskew(const pcl::PointCloud<PointT>& cloud,
+            const std::vector<float>& times,
+            double stamp,
+            const PoseBuffer& poses,
+            const Eigen::Isometry3d& reference,
+            pcl::PointCloud<PointT>& output)
+{
+    const int size = int(cloud.points.size());
+    if(poses.empty() || int(times.size())!=size) return false;
+
+    const Eigen::Isometry3d inverse_reference = reference.inverse();
+
+    output.header = cloud.header;
+    output.points.resize(size);
+    output.width = size;
+    output.height = 1;
+    output.is_dense = cloud.is_dense;
+
+#pragma omp parallel
+    {
+        // 同じ時刻の点が続くことが多いので、直前の姿勢を使い回す
+        bool cached = false;
+        float last_time = 0.0f;
+        Eigen::Matrix3f R = Eigen::Matrix3f::Identity();
+        Eigen::Vector3f t = Eigen::Vector3f::Zero();
+
+#pragma omp for schedule(static)
+        for(int i=0;i<size;i++){
+            if(!cached || times[i]!=last_time){
+                Eigen::Isometry3d pose;
+                poses.interpolate(stamp+times[i], pose);
+                Eigen::Isometry3d relative = inverse_reference*pose;
+                R = relative.linear().cast<float>();
+                t = relative.translation().cast<float>();
+                last_time = times[i];
+                cached = true;
+            }
+            const PointT& p = cloud.points[i];
+            Eigen::Vector3f q = R*Eigen::Vector3f(p.x, p.y, p.z) + t;
+            output.points[i] = p;
+            output.points[i].x = q[0];
+            output.points[i].y = q[1];
+            output.points[i].z = q[2];
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef _DIVISION_H_
+#define _DIVISION_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl_ros/point_cloud.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/sector_partition.h>
+
+#include <vector>
+#include <cmath>
+
+// SQ-LiDARの点群を center/left/right の3領域に分割する
+// 方位角 [-180, -60) : right, [-60, 60) : center, [60, 180] : left
+// node(src/division.cpp) と nodelet(src/nodelet/sensor_fusion_nodelets.cpp) で共通
+class Division{
+    private:
+        ros::Subscriber sub;
+        ros::Publisher pub_center;
+        ros::Publisher pub_left;
+        ros::Publisher pub_right;
+
+        double cell_size;
+        int grid_dimentions;
+
+        SectorPartition sector_partition;
+        std::vector<pcl::PointCloud<pcl::PointXYZ> > sectors;
+
+    public:
+        Division(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+        void pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg);
+        void area(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud);
+        void publish(const pcl::PointCloud<pcl::PointXYZ>& cloud, ros::Publisher& pub);
+};
+
+Division::Division(ros::NodeHandle nh, ros::NodeHandle pnh)
+    : cell_size(0.3), grid_dimentions(140)
+{
+    // grid_dimentions x grid_dimentions のグリッド内の点だけを使う
+    sector_partition.setNumSectors(3);
+    sector_partition.setStartAngle(-M_PI);
+    sector_partition.setCropSize(grid_dimentions/2*cell_size);
+
+    sub = nh.subscribe("/cloud", 10, &Division::pcCallback, this);
+
+    pub_center = nh.advertise<sensor_msgs::PointCloud2>("/cloud/center", 10);
+    pub_left   = nh.advertise<sensor_msgs::PointCloud2>("/cloud/left", 10);
+    pub_right  = nh.advertise<sensor_msgs::PointCloud2>("/cloud/right", 10);
+}
+
+void Division::pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+    pcl::PointCloud<pcl::PointXYZ>::Ptr pcl(new pcl::PointCloud<pcl::PointXYZ>);
+    pcl::fromROSMsg(*msg, *pcl);
+    area(pcl);
+}
+
+void Division::area(pcl::PointCloud<pcl::PointXYZ>::Ptr cloud)
+{
+    int size = cloud->size();
+    printf("size:%d\n",size);
+
+    sector_partition.partition(*cloud, sectors);
+
+    publish(sectors[1], pub_center);
+    publish(sectors[2], pub_left);
+    publish(sectors[0], pub_right);
+}
+
+// nodelet間ではshared_ptrのままやり取りされるので、Ptrでpublishする
+void Division::publish(const pcl::PointCloud<pcl::PointXYZ>& cloud, ros::Publisher& pub)
+{
+    sensor_msgs::PointCloud2Ptr pc2(new sensor_msgs::PointCloud2);
+    pcl::toROSMsg(cloud, *pc2);
+    pc2->header.stamp = ros::Time::now();
+    pc2->header.frame_id = "/centerlaser";
+    pub.publish(pc2);
+}
+
+#endif
@@ -1,7 +1,8 @@
 #include <iostream>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
+
+#include <sensor_fusion/voxel_filter.h>
 
 typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
@@ -10,8 +11,7 @@ typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 void down_sampling(CloudAPtr cloud, CloudAPtr& cloud_filtered, float size)
 {
     // Create the filtering object
-    pcl::VoxelGrid<PointA> sor;
-    sor.setInputCloud (cloud);
-    sor.setLeafSize (size, size, size);
-    sor.filter (*cloud_filtered);
+    VoxelFilter<PointA> sor;
+    sor.setLeafSize (size);
+    sor.filter (*cloud, *cloud_filtered);
 }
@@ -0,0 +1,188 @@
+#ifndef _EXTRINSIC_CALIBRATION_H_
+#define _EXTRINSIC_CALIBRATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/registration/icp.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <deque>
+#include <vector>
+#include <cmath>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "Eigen/Cholesky"
+
+// LiDARとカメラで検出したキャリブレーションターゲット(円の中心など)を時系列で貯め、
+// カメラ側の点をLiDAR側に合わせる外部パラメータを逐次推定する
+//
+// - 直近 window 回分の検出をまとめて1回のICPに使う (1回分の検出は数点しかないため)
+// - ICPは前回の推定値を初期値にして始める (毎回単位行列から解き直さない)
+// - 推定値の変化が閾値以下の更新が converge_count 回続いたら収束とする
+// - 推定値の共分散 (並進 x, y, z と微小回転 x, y, z 軸まわりの6x6) を対応点の残差から求める
+class ExtrinsicCalibration{
+    public:
+        typedef pcl::PointXYZ PointT;
+        typedef pcl::PointCloud<PointT> Cloud;
+        typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+    private:
+        std::deque<Cloud> lidar_window;
+        std::deque<Cloud> camera_window;
+        int window_size;
+
+        double max_correspondence_distance;
+        int max_iterations;
+
+        double converge_translation;
+        double converge_rotation;
+        int converge_count;
+        int stable_count;
+
+        Eigen::Matrix4f estimate;
+        Matrix6d cov;
+        double rmse;
+        int num_correspondences;
+        bool has_estimate;
+
+        // 対応点の残差から (J^T J)^-1 * σ^2 を求める
+        // J は推定値を左から微小変化 (δt, δω) させたときの残差 (T*p - q) の微分 [I, -[Tp]x]
+        void computeCovariance(const Cloud& source, const Cloud::Ptr& target)
+        {
+            pcl::KdTreeFLANN<PointT> kdtree;
+            kdtree.setInputCloud(target);
+
+            const Eigen::Matrix3f R = estimate.topLeftCorner<3, 3>();
+            const Eigen::Vector3f t = estimate.topRightCorner<3, 1>();
+            const float max_sq = float(max_correspondence_distance*max_correspondence_distance);
+
+            Matrix6d H = Matrix6d::Zero();
+            double sum_sq = 0.0;
+            int n = 0;
+            std::vector<int> index(1);
+            std::vector<float> sq_distance(1);
+            for(size_t i=0;i<source.points.size();i++){
+                const Eigen::Vector3f p = R*source.points[i].getVector3fMap() + t;
+                PointT query;
+                query.x = p[0]; query.y = p[1]; query.z = p[2];
+                if(kdtree.nearestKSearch(query, 1, index, sq_distance)<1 || max_sq<sq_distance[0]) continue;
+
+                const Eigen::Vector3d q = p.cast<double>();
+                Eigen::Matrix<double, 3, 6> J;
+                J.leftCols<3>().setIdentity();
+                J.rightCols<3>() <<  0.0,   q[2], -q[1],
+                                    -q[2],  0.0,   q[0],
+                                     q[1], -q[0],  0.0;
+                H.noalias() += J.transpose()*J;
+                sum_sq += sq_distance[0];
+                n++;
+            }
+
+            num_correspondences = n;
+            rmse = (0<n) ? std::sqrt(sum_sq/n) : 0.0;
+            cov = Matrix6d::Identity()*1e6;
+            // 6自由度に対して観測(3n)が足りなければ共分散は大きいままにする
+            if(3*n<=6) return;
+            const double sigma_sq = sum_sq/(3*n - 6);
+            const Eigen::LDLT<Matrix6d> ldlt(H);
+            if(ldlt.info()!=Eigen::Success || !ldlt.isPositive()) return;
+            cov = sigma_sq*ldlt.solve(Matrix6d::Identity());
+        }
+
+    public:
+        ExtrinsicCalibration()
+            : window_size(50),
+              max_correspondence_distance(0.1),
+              max_iterations(30),
+              converge_translation(1e-3),
+              converge_rotation(1e-3),
+              converge_count(5),
+              stable_count(0),
+              estimate(Eigen::Matrix4f::Identity()),
+              cov(Matrix6d::Identity()*1e6),
+              rmse(0.0),
+              num_correspondences(0),
+              has_estimate(false) {}
+
+        void setWindowSize(int size){ window_size = size; }
+        void setMaxCorrespondenceDistance(double distance){ max_correspondence_distance = distance; }
+        void setMaximumIterations(int iterations){ max_iterations = iterations; }
+        void setConvergence(double translation, double rotation, int count)
+        {
+            converge_translation = translation;
+            converge_rotation = rotation;
+            converge_count = count;
+        }
+
+        // 前回のキャリブレーション結果などを初期値にする
+        void setInitialGuess(const Eigen::Matrix4f& guess)
+        {
+            estimate = guess;
+            has_estimate = true;
+        }
+
+        // 同時刻の検出 (lidar : ICPのtarget, camera : source)
+        void addObservation(const Cloud& lidar, const Cloud& camera)
+        {
+            if(lidar.points.empty() || camera.points.empty()) return;
+            lidar_window.push_back(lidar);
+            camera_window.push_back(camera);
+            while(window_size<int(lidar_window.size())){
+                lidar_window.pop_front();
+                camera_window.pop_front();
+            }
+        }
+
+        int observations() const { return int(lidar_window.size()); }
+
+        // 貯めた検出でICPを1回行い、推定値を更新する (ICPが収束しなければfalse)
+        bool update()
+        {
+            if(lidar_window.empty()) return false;
+
+            Cloud::Ptr target(new Cloud);
+            Cloud::Ptr source(new Cloud);
+            for(size_t i=0;i<lidar_window.size();i++){
+                *target += lidar_window[i];
+                *source += camera_window[i];
+            }
+
+            pcl::IterativeClosestPoint<PointT, PointT> icp;
+            icp.setMaxCorrespondenceDistance(has_estimate ? max_correspondence_distance : 10.0*max_correspondence_distance);
+            icp.setMaximumIterations(max_iterations);
+            icp.setTransformationEpsilon(1e-10);
+            icp.setInputTarget(target);
+            icp.setInputSource(source);
+
+            Cloud aligned;
+            icp.align(aligned, estimate);
+            if(!icp.hasConverged()) return false;
+
+            const Eigen::Matrix4f previous = estimate;
+            estimate = icp.getFinalTransformation();
+            has_estimate = true;
+
+            // 前回からの変化量
+            const Eigen::Matrix4f delta = previous.inverse()*estimate;
+            const double translation = delta.topRightCorner<3, 1>().norm();
+            const double rotation = Eigen::AngleAxisf(Eigen::Matrix3f(delta.topLeftCorner<3, 3>())).angle();
+            if(translation<converge_translation && rotation<converge_rotation) stable_count++;
+            else stable_count = 0;
+
+            computeCovariance(*source, target);
+            return true;
+        }
+
+        bool converged() const { return converge_count<=stable_count; }
+
+        const Eigen::Matrix4f& transform() const { return estimate; }
+
+        // (x, y, z, 回転 x, y, z 軸まわり) の共分散 (geometry_msgs/PoseWithCovariance と同じ並び)
+        const Matrix6d& covariance() const { return cov; }
+
+        double getRMSE() const { return rmse; }
+        int correspondences() const { return num_correspondences; }
+};
+
+#endif
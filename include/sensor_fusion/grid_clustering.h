@@ -0,0 +1,285 @@
+#ifndef _GRID_CLUSTERING_H_
+#define _GRID_CLUSTERING_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/index_partition.h>
+#include <sensor_fusion/voxel_filter.h>
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <stdint.h>
+
+#include "Eigen/Core"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// クラスタのAABB
+struct ClusterBounds{
+    Eigen::Vector3f min_p;
+    Eigen::Vector3f max_p;
+};
+
+// x-y平面のグリッドによるクラスタリング
+// zを0にしてEuclideanClusterExtractionを行っていた処理の置き換え (同じクラスタになる)
+//
+// 1. 各点を一辺 tolerance/√2 のセルに入れ、セル座標でソートして占有セルごとの点のリストを作る
+//    セルの対角線が tolerance なので、同じセルの点どうしは必ずつながる
+//    占有セルだけを持つので、点群の範囲が広くてもメモリは点数に比例する
+// 2. 距離が tolerance 以内の点がありうるのは周囲 5x5 のセルなので、その範囲の占有セルの組ごとに
+//    tolerance 以内の点の組があるかを並列に調べ、あればunion-findでセルをつなぐ
+//    セルはソート済みなので、隣のセルは列ごとのポインタを進めるだけで見つかる
+// 3. 各点にクラスタ番号を付け、同じループでクラスタごとのAABBを求める
+// 4. 点数が min_size ~ max_size のクラスタだけをindexリストとして返す
+//
+// KdTreeを作らず、点ごとの近傍探索の代わりに周囲のセルの点だけを調べる
+// クラスタの並びは各クラスタの最初の点の順 (スレッド数によらない)
+class GridClustering{
+    private:
+        double tolerance;
+        int min_size;
+        int max_size;
+
+        // 1セルあたりのつながる相手の最大数 (5x5 のうち前方の12セル)
+        static int maxEdges() { return 12; }
+
+        std::vector<std::pair<uint64_t, int> > sorted;  // (セル座標, 点) をセル座標, 点の順に並べたもの
+        std::vector<int> cell;              // 点 -> セル (-1 : 無効な点)
+        std::vector<uint64_t> cell_keys;    // セル -> セル座標 (昇順)
+        std::vector<int> cell_offset;       // セルcの点は cell_points[cell_offset[c]] ~ cell_points[cell_offset[c+1]-1]
+        std::vector<int> cell_points;
+        std::vector<float> cell_xy;         // cell_points の順に並べた点の x,y (距離を調べるときに点群を飛び飛びに読まない)
+        std::vector<int> edges;             // edges[c*maxEdges()+k] : セルcとつながるセル (-1 : なし)
+        std::vector<int> parent;            // セル -> union-findの親
+        std::vector<int> label;             // 点 -> クラスタ
+
+        // セル座標 (x, y) を x, y の辞書順に並ぶ64bit値にまとめる
+        // (各32bitあれば tolerance が1cmでも ±2万km まで表せる)
+        static uint64_t key(int64_t x, int64_t y)
+        {
+            return (uint64_t(uint32_t(x) ^ 0x80000000u) << 32) | uint64_t(uint32_t(y) ^ 0x80000000u);
+        }
+        static int64_t keyX(uint64_t key) { return int32_t(uint32_t(key >> 32) ^ 0x80000000u); }
+        static int64_t keyY(uint64_t key) { return int32_t(uint32_t(key) ^ 0x80000000u); }
+
+        // セルaとセルbに距離が tolerance 以内の点の組があるか
+        bool connected(int a, int b, float squared_tolerance) const
+        {
+            for(int i=cell_offset[a];i<cell_offset[a+1];i++){
+                const float px = cell_xy[2*i];
+                const float py = cell_xy[2*i+1];
+                for(int j=cell_offset[b];j<cell_offset[b+1];j++){
+                    const float dx = px - cell_xy[2*j];
+                    const float dy = py - cell_xy[2*j+1];
+                    if(dx*dx + dy*dy<=squared_tolerance) return true;
+                }
+            }
+            return false;
+        }
+
+        int find(int c)
+        {
+            while(parent[c]!=c){
+                parent[c] = parent[parent[c]];
+                c = parent[c];
+            }
+            return c;
+        }
+
+        void unite(int a, int b)
+        {
+            a = find(a);
+            b = find(b);
+            if(a==b) return;
+            if(a<b) parent[b] = a;
+            else parent[a] = b;
+        }
+
+    public:
+        GridClustering()
+            : tolerance(0.15), min_size(1), max_size(std::numeric_limits<int>::max()) {}
+
+        GridClustering(double tolerance_, int min_size_, int max_size_)
+            : tolerance(tolerance_), min_size(min_size_), max_size(max_size_) {}
+
+        void setClusterTolerance(double tolerance_){ tolerance = tolerance_; }
+        void setMinClusterSize(int min_size_){ min_size = min_size_; }
+        void setMaxClusterSize(int max_size_){ max_size = max_size_; }
+
+        // 直前の extract() での各点のクラスタ番号 (-1 : どのクラスタにも属さない)
+        const std::vector<int>& labels() const { return label; }
+
+        // clusters[k] : クラスタkの点のindex(入力順), bounds[k] : そのAABB
+        template<typename PointT>
+        void extract(const pcl::PointCloud<PointT>& cloud,
+                     std::vector<std::vector<int> >& clusters,
+                     std::vector<ClusterBounds>& bounds);
+
+        template<typename PointT>
+        void extract(const pcl::PointCloud<PointT>& cloud,
+                     std::vector<std::vector<int> >& clusters)
+        {
+            std::vector<ClusterBounds> bounds;
+            extract(cloud, clusters, bounds);
+        }
+};
+
+template<typename PointT>
+void GridClustering::extract(const pcl::PointCloud<PointT>& cloud,
+                             std::vector<std::vector<int> >& clusters,
+                             std::vector<ClusterBounds>& bounds)
+{
+    const int size = int(cloud.points.size());
+
+    clusters.clear();
+    bounds.clear();
+    label.assign(size, -1);
+    if(size==0) return;
+
+    const double inv_cell = std::sqrt(2.0)/tolerance;
+    const float squared_tolerance = float(tolerance*tolerance);
+
+    // 1. 点 -> セル座標
+    sorted.resize(size);
+    cell.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        VoxelKey v;
+        if(!voxel_key(cloud.points[i], inv_cell, v)){
+            cell[i] = -1;
+            continue;
+        }
+        cell[i] = 0;
+        sorted[i] = std::make_pair(key(v.x, v.y), i);
+    }
+    //    無効な点を除いてセル座標, 点の順にソートし、占有セルと各セルの点のリスト(入力順)を作る
+    int valid = 0;
+    for(int i=0;i<size;i++)
+        if(0<=cell[i]) sorted[valid++] = sorted[i];
+    sorted.resize(valid);
+    std::sort(sorted.begin(), sorted.end());
+
+    cell_keys.clear();
+    cell_offset.clear();
+    cell_points.resize(valid);
+    cell_xy.resize(2*valid);
+    for(int j=0;j<valid;j++){
+        if(j==0 || sorted[j].first!=sorted[j-1].first){
+            cell_keys.push_back(sorted[j].first);
+            cell_offset.push_back(j);
+        }
+        const int i = sorted[j].second;
+        cell[i] = int(cell_keys.size()) - 1;
+        cell_points[j] = i;
+        cell_xy[2*j]   = cloud.points[i].x;
+        cell_xy[2*j+1] = cloud.points[i].y;
+    }
+    cell_offset.push_back(valid);
+    const int num_cells = int(cell_keys.size());
+    if(num_cells==0) return;
+
+    // 2. 前方のセル (同じ列の y+1, y+2 と、x+1, x+2 の列の y-2 ~ y+2) とつながるかを並列に調べる
+    //    セルは (x, y) の昇順なので、列ごとの探索開始位置はセルの順に単調に進む
+    const int max_edges = maxEdges();
+    edges.assign(num_cells*max_edges, -1);
+#pragma omp parallel
+    {
+        int tid = 0;
+        int num = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        num = omp_get_num_threads();
+#endif
+        const int begin = int((long long)num_cells*tid/num);
+        const int end   = int((long long)num_cells*(tid+1)/num);
+
+        int next[3] = {begin, begin, begin};
+        for(int c=begin;c<end;c++){
+            const int64_t x = keyX(cell_keys[c]);
+            const int64_t y = keyY(cell_keys[c]);
+            int k = 0;
+            for(int dx=0;dx<=2;dx++){
+                const uint64_t lower = key(x + dx, (dx==0) ? y + 1 : y - 2);
+                const uint64_t upper = key(x + dx, y + 2);
+                int& n = next[dx];
+                while(n<num_cells && cell_keys[n]<lower) n++;
+                for(int m=n;m<num_cells && cell_keys[m]<=upper;m++)
+                    if(connected(c, m, squared_tolerance)) edges[c*max_edges + k++] = m;
+            }
+        }
+    }
+
+    parent.resize(num_cells);
+    for(int c=0;c<num_cells;c++) parent[c] = c;
+    for(int c=0;c<num_cells;c++){
+        for(int k=0;k<max_edges;k++){
+            const int n = edges[c*max_edges+k];
+            if(n<0) break;
+            unite(c, n);
+        }
+    }
+
+    // 根ごとの点数を数え、点数が範囲内のクラスタに最初の点の順で番号を振る
+    std::vector<int> count(num_cells, 0);
+    for(int i=0;i<size;i++){
+        if(cell[i]<0) continue;
+        cell[i] = find(cell[i]);
+        count[cell[i]]++;
+    }
+    std::vector<int> number(num_cells, -1);
+    int num_clusters = 0;
+    for(int i=0;i<size;i++){
+        if(cell[i]<0) continue;
+        const int r = cell[i];
+        if(number[r]<0 && min_size<=count[r] && count[r]<=max_size) number[r] = num_clusters++;
+    }
+
+    // 3. 点 -> クラスタ とAABBを同じループで求める
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    ClusterBounds empty;
+    empty.min_p.setConstant( std::numeric_limits<float>::max());
+    empty.max_p.setConstant(-std::numeric_limits<float>::max());
+    std::vector<ClusterBounds> local_bounds(threads*num_clusters, empty);
+
+    label.resize(size);
+#pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        ClusterBounds* local = (0<num_clusters) ? &local_bounds[tid*num_clusters] : 0;
+
+#pragma omp for schedule(static)
+        for(int i=0;i<size;i++){
+            const int k = (cell[i]<0) ? -1 : number[cell[i]];
+            label[i] = k;
+            if(k<0) continue;
+            const Eigen::Vector3f p(cloud.points[i].x, cloud.points[i].y, cloud.points[i].z);
+            local[k].min_p = local[k].min_p.cwiseMin(p);
+            local[k].max_p = local[k].max_p.cwiseMax(p);
+        }
+    }
+
+    bounds.assign(num_clusters, empty);
+    for(int t=0;t<threads;t++){
+        for(int k=0;k<num_clusters;k++){
+            bounds[k].min_p = bounds[k].min_p.cwiseMin(local_bounds[t*num_clusters+k].min_p);
+            bounds[k].max_p = bounds[k].max_p.cwiseMax(local_bounds[t*num_clusters+k].max_p);
+        }
+    }
+
+    // 4. クラスタごとのindexリスト
+    partition_indices(label, num_clusters, clusters);
+}
+
+#endif
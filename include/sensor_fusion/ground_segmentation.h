@@ -0,0 +1,293 @@
+#ifndef _GROUND_SEGMENTATION_H_
+#define _GROUND_SEGMENTATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/io.h>
+
+#include <sensor_fusion/index_partition.h>
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Min-Max法による地面除去
+// x-y平面を grid_dimentions x grid_dimentions のセルに分割し、
+// セル内の高さの差(max z - min z)が height_threshold を超えるセルの点を障害物、
+// それ以外を地面とする
+//
+// 1. 各点のセル番号を一度だけ計算してindex配列に保存
+// 2. スレッドごとのmin/maxグリッドに並列に書き込み、最後にまとめる
+// 3. 点群はコピーせず、obstacle/groundのindexリストとして返す
+class MinMaxGroundSegmentation{
+    private:
+        int grid_dimentions;
+        double cell_size;
+        double height_threshold;
+
+        // 呼び出しごとに再確保しないよう保持しておく
+        std::vector<int> cell;
+        std::vector<int> label;
+        std::vector<float> min_z;
+        std::vector<float> max_z;
+
+    public:
+        MinMaxGroundSegmentation()
+            : grid_dimentions(100), cell_size(1.0), height_threshold(0.5) {}
+
+        MinMaxGroundSegmentation(int grid_dimentions_, double cell_size_, double height_threshold_)
+            : grid_dimentions(grid_dimentions_), cell_size(cell_size_), height_threshold(height_threshold_) {}
+
+        void setGridDimentions(int grid_dimentions_){ grid_dimentions = grid_dimentions_; }
+        void setCellSize(double cell_size_){ cell_size = cell_size_; }
+        void setHeightThreshold(double height_threshold_){ height_threshold = height_threshold_; }
+
+        // グリッド外の点はどちらのリストにも入らない
+        template<typename PointT>
+        void segment(const pcl::PointCloud<PointT>& cloud,
+                     std::vector<int>& obstacle,
+                     std::vector<int>& ground);
+
+        template<typename PointT>
+        void segment(const pcl::PointCloud<PointT>& cloud,
+                     pcl::PointCloud<PointT>& obstacle,
+                     pcl::PointCloud<PointT>& ground);
+};
+
+template<typename PointT>
+void MinMaxGroundSegmentation::segment(const pcl::PointCloud<PointT>& cloud,
+                                       std::vector<int>& obstacle,
+                                       std::vector<int>& ground)
+{
+    const int size = int(cloud.points.size());
+    const int grid_size = grid_dimentions*grid_dimentions;
+    const int half = grid_dimentions/2;
+    const float inv_cell = float(1.0/cell_size);
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    cell.resize(size);
+    label.resize(size);
+    min_z.assign((threads+1)*grid_size,  std::numeric_limits<float>::max());
+    max_z.assign((threads+1)*grid_size, -std::numeric_limits<float>::max());
+
+    // セル番号の計算とスレッドごとのmin/max
+#pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        float* local_min = &min_z[(tid+1)*grid_size];
+        float* local_max = &max_z[(tid+1)*grid_size];
+
+#pragma omp for schedule(static)
+        for(int i=0;i<size;i++){
+            const PointT& p = cloud.points[i];
+            int id = -1;
+            if(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)){
+                // 元の実装 (min_max.cpp, evaluate.cpp) は (grid_dimentions/2)+x/cell_size を int に切り捨てていた
+                // 和が0以上なら切り捨てと floor は同じセルになるが、グリッドの負の端から1セル以内 (和が -1~0) の点は
+                // 切り捨てではセル0に入り、ここではグリッド外になる (端のセルに範囲外の点を混ぜない)
+                // また積は float なので、セル境界ちょうどの点は元と隣のセルになることがある
+                int x = half + int(std::floor(p.x*inv_cell));
+                int y = half + int(std::floor(p.y*inv_cell));
+                if(0<=x && x<grid_dimentions && 0<=y && y<grid_dimentions){
+                    id = x*grid_dimentions + y;
+                    local_min[id] = std::min(local_min[id], p.z);
+                    local_max[id] = std::max(local_max[id], p.z);
+                }
+            }
+            cell[i] = id;
+        }
+    }
+
+    // スレッドごとの結果を先頭のグリッドにまとめる
+#pragma omp parallel for schedule(static)
+    for(int id=0;id<grid_size;id++){
+        float lo = min_z[id];
+        float hi = max_z[id];
+        for(int t=1;t<=threads;t++){
+            lo = std::min(lo, min_z[t*grid_size+id]);
+            hi = std::max(hi, max_z[t*grid_size+id]);
+        }
+        min_z[id] = lo;
+        max_z[id] = hi;
+    }
+
+    // 0 : obstacle, 1 : ground, -1 : グリッド外
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        int id = cell[i];
+        if(id<0) label[i] = -1;
+        else label[i] = (height_threshold<max_z[id]-min_z[id]) ? 0 : 1;
+    }
+
+    std::vector<std::vector<int> > output;
+    partition_indices(label, 2, output);
+    obstacle.swap(output[0]);
+    ground.swap(output[1]);
+}
+
+template<typename PointT>
+void MinMaxGroundSegmentation::segment(const pcl::PointCloud<PointT>& cloud,
+                                       pcl::PointCloud<PointT>& obstacle,
+                                       pcl::PointCloud<PointT>& ground)
+{
+    std::vector<int> obstacle_indices;
+    std::vector<int> ground_indices;
+    segment(cloud, obstacle_indices, ground_indices);
+
+    pcl::copyPointCloud(cloud, obstacle_indices, obstacle);
+    pcl::copyPointCloud(cloud, ground_indices, ground);
+}
+
+// Min-Max法の疎グリッド版
+// セルをハッシュマップで持つので、原点中心の固定サイズグリッドに収まらない
+// global座標系の統合Mapでも点を切り捨てずに処理でき、
+// メモリ使用量は点が存在するセル数に比例する
+class SparseMinMaxGroundSegmentation{
+    private:
+        struct Range{
+            float min_z;
+            float max_z;
+        };
+        typedef std::unordered_map<uint64_t, Range> CellMap;
+
+        double cell_size;
+        double height_threshold;
+
+        std::vector<uint64_t> key;
+        std::vector<int> label;
+        CellMap cells;
+
+        static uint64_t cellKey(int x, int y)
+        {
+            return (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(y));
+        }
+
+    public:
+        SparseMinMaxGroundSegmentation()
+            : cell_size(1.0), height_threshold(0.5) {}
+
+        SparseMinMaxGroundSegmentation(double cell_size_, double height_threshold_)
+            : cell_size(cell_size_), height_threshold(height_threshold_) {}
+
+        void setCellSize(double cell_size_){ cell_size = cell_size_; }
+        void setHeightThreshold(double height_threshold_){ height_threshold = height_threshold_; }
+
+        // 直前のsegment()で点が存在したセル数
+        size_t occupiedCells() const { return cells.size(); }
+
+        // NaNを含む点はどちらのリストにも入らない
+        template<typename PointT>
+        void segment(const pcl::PointCloud<PointT>& cloud,
+                     std::vector<int>& obstacle,
+                     std::vector<int>& ground);
+
+        template<typename PointT>
+        void segment(const pcl::PointCloud<PointT>& cloud,
+                     pcl::PointCloud<PointT>& obstacle,
+                     pcl::PointCloud<PointT>& ground);
+};
+
+template<typename PointT>
+void SparseMinMaxGroundSegmentation::segment(const pcl::PointCloud<PointT>& cloud,
+                                             std::vector<int>& obstacle,
+                                             std::vector<int>& ground)
+{
+    const int size = int(cloud.points.size());
+    const double inv_cell = 1.0/cell_size;
+
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    key.resize(size);
+    label.resize(size);
+    cells.clear();
+
+    // スレッドごとのセルマップに書き込み、最後にまとめる
+    std::vector<CellMap> local_cells(threads);
+
+#pragma omp parallel
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        CellMap& local = local_cells[tid];
+
+#pragma omp for schedule(static)
+        for(int i=0;i<size;i++){
+            const PointT& p = cloud.points[i];
+            if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)){
+                label[i] = -1;
+                continue;
+            }
+            uint64_t k = cellKey(int(std::floor(p.x*inv_cell)), int(std::floor(p.y*inv_cell)));
+            key[i] = k;
+            label[i] = 0;
+
+            typename CellMap::iterator it = local.find(k);
+            if(it==local.end()){
+                Range r = {p.z, p.z};
+                local.insert(std::make_pair(k, r));
+            }
+            else{
+                it->second.min_z = std::min(it->second.min_z, p.z);
+                it->second.max_z = std::max(it->second.max_z, p.z);
+            }
+        }
+    }
+
+    for(int t=0;t<threads;t++){
+        for(typename CellMap::const_iterator it=local_cells[t].begin(); it!=local_cells[t].end(); ++it){
+            std::pair<typename CellMap::iterator, bool> res = cells.insert(*it);
+            if(!res.second){
+                res.first->second.min_z = std::min(res.first->second.min_z, it->second.min_z);
+                res.first->second.max_z = std::max(res.first->second.max_z, it->second.max_z);
+            }
+        }
+        CellMap().swap(local_cells[t]);
+    }
+
+    // 0 : obstacle, 1 : ground, -1 : 無効な点
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        if(label[i]<0) continue;
+        const Range& r = cells.find(key[i])->second;
+        label[i] = (height_threshold<r.max_z-r.min_z) ? 0 : 1;
+    }
+
+    std::vector<std::vector<int> > output;
+    partition_indices(label, 2, output);
+    obstacle.swap(output[0]);
+    ground.swap(output[1]);
+}
+
+template<typename PointT>
+void SparseMinMaxGroundSegmentation::segment(const pcl::PointCloud<PointT>& cloud,
+                                             pcl::PointCloud<PointT>& obstacle,
+                                             pcl::PointCloud<PointT>& ground)
+{
+    std::vector<int> obstacle_indices;
+    std::vector<int> ground_indices;
+    segment(cloud, obstacle_indices, ground_indices);
+
+    pcl::copyPointCloud(cloud, obstacle_indices, obstacle);
+    pcl::copyPointCloud(cloud, ground_indices, ground);
+}
+
+#endif
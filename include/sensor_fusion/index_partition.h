@@ -0,0 +1,69 @@
+#ifndef _INDEX_PARTITION_H_
+#define _INDEX_PARTITION_H_
+
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// label[i] (0 <= label < num_labels) に従って点のindexを振り分ける
+// label < 0 の点はどこにも入らない
+// 各スレッドが担当区間のラベル数を数え、prefix sumで書き込み位置を決めてから
+// 並列に書き込むので、出力の順序は入力順と一致する
+inline void partition_indices(const std::vector<int>& label,
+                              int num_labels,
+                              std::vector<std::vector<int> >& output)
+{
+    const int size = int(label.size());
+
+    output.resize(num_labels);
+
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    // count[t*num_labels + l] : スレッドtの担当区間にあるラベルlの点数
+    std::vector<int> count((max_threads+1)*num_labels, 0);
+
+#pragma omp parallel
+    {
+        int tid = 0;
+        int num = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        num = omp_get_num_threads();
+#endif
+        const int begin = int((long long)size*tid/num);
+        const int end   = int((long long)size*(tid+1)/num);
+
+        int* local = &count[(tid+1)*num_labels];
+        for(int i=begin;i<end;i++){
+            if(0<=label[i]) local[label[i]]++;
+        }
+
+#pragma omp barrier
+#pragma omp single
+        {
+            // count[t] をスレッドtの書き込み開始位置に変換
+            for(int l=0;l<num_labels;l++){
+                int offset = 0;
+                for(int t=0;t<num;t++){
+                    int c = count[(t+1)*num_labels+l];
+                    count[t*num_labels+l] = offset;
+                    offset += c;
+                }
+                output[l].resize(offset);
+            }
+        }
+
+        std::vector<int> cursor(count.begin()+tid*num_labels, count.begin()+(tid+1)*num_labels);
+        for(int i=begin;i<end;i++){
+            int l = label[i];
+            if(0<=l) output[l][cursor[l]++] = i;
+        }
+    }
+}
+
+#endif
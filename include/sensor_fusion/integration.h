@@ -0,0 +1,114 @@
+#ifndef _INTEGRATION_H_
+#define _INTEGRATION_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl_ros/point_cloud.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include <boost/bind.hpp>
+
+#include <iostream>
+
+// center/right/leftの点群を時刻同期して1つの点群に統合する
+// node(src/integration.cpp) と nodelet(src/nodelet/sensor_fusion_nodelets.cpp) で共通
+class Integration{
+    private:
+        typedef sensor_msgs::PointCloud2 PointCloud2;
+        typedef message_filters::sync_policies::ApproximateTime<PointCloud2, PointCloud2, PointCloud2> SyncPolicy;
+
+        message_filters::Subscriber<PointCloud2> center_sub;
+        message_filters::Subscriber<PointCloud2> right_sub;
+        message_filters::Subscriber<PointCloud2> left_sub;
+        message_filters::Synchronizer<SyncPolicy> sync;
+
+        ros::Publisher pub;
+
+    public:
+        Integration(ros::NodeHandle nh, ros::NodeHandle pnh);
+
+        void callback(const sensor_msgs::PointCloud2ConstPtr& center_msg,
+                      const sensor_msgs::PointCloud2ConstPtr& right_msg,
+                      const sensor_msgs::PointCloud2ConstPtr& left_msg);
+};
+
+Integration::Integration(ros::NodeHandle nh, ros::NodeHandle pnh)
+    : center_sub(nh, "/sq_lidar/points/center", 10),
+      right_sub(nh, "/sq_lidar/points/right" , 10),
+      left_sub(nh, "/sq_lidar/points/left"  , 10),
+      sync(SyncPolicy(10), center_sub, right_sub, left_sub)
+{
+    sync.registerCallback(boost::bind(&Integration::callback, this, _1, _2, _3));
+    pub = nh.advertise<sensor_msgs::PointCloud2>("/sq_lidar/points/integrate", 1);
+}
+
+void Integration::callback(const sensor_msgs::PointCloud2ConstPtr& center_msg,
+                           const sensor_msgs::PointCloud2ConstPtr& right_msg,
+                           const sensor_msgs::PointCloud2ConstPtr& left_msg)
+{
+	std::cout<<"ALL GREEN"<<std::endl;
+
+	const sensor_msgs::PointCloud2ConstPtr msgs[3] = {center_msg, right_msg, left_msg};
+
+	sensor_msgs::PointCloud2Ptr output(new sensor_msgs::PointCloud2);
+
+	// 3つの点群のフィールド構成が同じなら、PCLを経由せずにバイト列をそのまま連結する
+	bool same_layout = true;
+	for(int i=1;i<3;i++){
+		if(msgs[i]->point_step!=center_msg->point_step || msgs[i]->fields.size()!=center_msg->fields.size())
+			same_layout = false;
+		for(size_t f=0;same_layout && f<center_msg->fields.size();f++){
+			if(msgs[i]->fields[f].name!=center_msg->fields[f].name
+			   || msgs[i]->fields[f].offset!=center_msg->fields[f].offset
+			   || msgs[i]->fields[f].datatype!=center_msg->fields[f].datatype)
+				same_layout = false;
+		}
+	}
+
+	if(same_layout){
+		size_t bytes = 0;
+		for(int i=0;i<3;i++) bytes += msgs[i]->data.size();
+
+		output->fields       = center_msg->fields;
+		output->is_bigendian = center_msg->is_bigendian;
+		output->point_step   = center_msg->point_step;
+		output->is_dense     = center_msg->is_dense && right_msg->is_dense && left_msg->is_dense;
+		output->data.reserve(bytes);
+		for(int i=0;i<3;i++){
+			// row_step分のパディングがある組織化点群は点ごとに詰めて連結する
+			// Divisionは点のないセクタも publish するので、data が空のものは飛ばす
+			const sensor_msgs::PointCloud2& msg = *msgs[i];
+			if(msg.data.empty()) continue;
+			for(uint32_t row=0;row<msg.height;row++){
+				const uint8_t* begin = msg.data.data() + size_t(row)*msg.row_step;
+				output->data.insert(output->data.end(), begin, begin + size_t(msg.width)*msg.point_step);
+			}
+		}
+		output->height   = 1;
+		output->width    = (0<output->point_step) ? output->data.size()/output->point_step : 0;
+		output->row_step = output->data.size();
+	}
+	else{
+		pcl::PointCloud<pcl::PointXYZRGB> integrate_cloud;
+		for(int i=0;i<3;i++){
+			pcl::PointCloud<pcl::PointXYZRGB> cloud;
+			pcl::fromROSMsg(*msgs[i], cloud);
+			integrate_cloud += cloud;
+		}
+		pcl::toROSMsg(integrate_cloud, *output);
+	}
+
+	if(0<output->width){
+		output->header.frame_id = "/centerlaser";
+		output->header.stamp = ros::Time::now();
+		pub.publish(output);
+	}
+}
+
+#endif
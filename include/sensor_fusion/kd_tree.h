@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <random>
 
 typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA>  CloudA;
@@ -11,46 +12,137 @@ typedef pcl::PointCloud<PointA>::Ptr  CloudAPtr;
 using namespace std;
 
 
-void neighbors_with_radius_Search(CloudAPtr cloud,
+// 点群ごとに1回だけ作る探索インデックス
+// KdTreeFLANN の探索はconstで複数スレッドから同時に呼べるので、クエリ点群をまとめて並列に探索する
+class SearchIndex{
+    private:
+        CloudAPtr cloud;
+        pcl::KdTreeFLANN<PointA> kdtree;
+
+    public:
+        SearchIndex() {}
+
+        SearchIndex(CloudAPtr cloud_)
+        {
+            setInputCloud(cloud_);
+        }
+
+        void setInputCloud(CloudAPtr cloud_)
+        {
+            cloud = cloud_;
+            kdtree.setInputCloud(cloud);
+        }
+
+        CloudAPtr getInputCloud() const { return cloud; }
+
+        // 各クエリ点の半径 radius 内の点数
+        void radiusCount(const CloudA& queries, float radius, vector<int>& counts) const
+        {
+            const int size = int(queries.points.size());
+            counts.resize(size);
+#pragma omp parallel
+            {
+                vector<int> indices;
+                vector<float> distances;
+#pragma omp for schedule(dynamic, 16)
+                for(int i=0;i<size;i++)
+                    counts[i] = kdtree.radiusSearch(queries.points[i], radius, indices, distances);
+            }
+        }
+
+        // 各クエリ点の半径 radius 内の点のindex
+        void radiusSearch(const CloudA& queries, float radius, vector<vector<int> >& indices) const
+        {
+            const int size = int(queries.points.size());
+            indices.resize(size);
+#pragma omp parallel
+            {
+                vector<float> distances;
+#pragma omp for schedule(dynamic, 16)
+                for(int i=0;i<size;i++)
+                    kdtree.radiusSearch(queries.points[i], radius, indices[i], distances);
+            }
+        }
+
+        // 各クエリ点の最近傍 K 点のindex (近い順)
+        void nearestKSearch(const CloudA& queries, int K, vector<vector<int> >& indices) const
+        {
+            const int size = int(queries.points.size());
+            indices.resize(size);
+#pragma omp parallel
+            {
+                vector<float> distances(K);
+#pragma omp for schedule(dynamic, 16)
+                for(int i=0;i<size;i++){
+                    indices[i].resize(K);
+                    const int found = kdtree.nearestKSearch(queries.points[i], K, indices[i], distances);
+                    indices[i].resize(max(found, 0));
+                }
+            }
+        }
+};
+
+// point を中心に count 個の候補点をばらまく
+// 各軸 0.00005 * [-512, 511] の一様乱数 (rand()%1024 - 512 と同じ分布)で、seed が同じなら同じ点列になる
+void scatter_points(PointA point, int count, unsigned int seed, CloudA& points)
+{
+    mt19937 engine(seed);
+    uniform_int_distribution<int> offset(-512, 511);
+
+    const size_t begin = points.points.size();
+    points.points.resize(begin + count);
+    for(int i=0;i<count;i++)
+    {
+        PointA& p = points.points[begin+i];
+        p.x = point.x + 0.00005 * offset(engine);
+        p.y = point.y + 0.00005 * offset(engine);
+        p.z = point.z + 0.00005 * offset(engine);
+    }
+    points.width = points.points.size();
+    points.height = 1;
+}
+
+void neighbors_with_radius_Search(const SearchIndex& index,
                                   PointA point,
                                   CloudAPtr& searchPoints,
-                                  PointA& centroid)
+                                  PointA& centroid,
+                                  unsigned int seed = 1)
 {
     printf("Reference Point ( %.3f %.3f %.3f )\n", point.x, point.y, point.z);
-    
+
     // pointを中心に1000パーティクルをばらまく
-    for(int i=0;i<1000;i++)
-    {
-        PointA searchPoint;
-        searchPoint.x = point.x + 0.00005 * (rand()%1024 - 512);
-        searchPoint.y = point.y + 0.00005 * (rand()%1024 - 512);
-        searchPoint.z = point.z + 0.00005 * (rand()%1024 - 512);
-        searchPoints->points.push_back(searchPoint);
-    }
+    CloudA candidates;
+    scatter_points(point, 1000, seed, candidates);
+    *searchPoints += candidates;
 
     // 近傍点群を探索し、cloudと重なる点群数が最も小さい中心点を算出
-    pcl::KdTreeFLANN<pcl::PointXYZ> kdtree;
-    kdtree.setInputCloud (cloud);
-    std::vector<int> pointIdxRadiusSearch;
-    std::vector<float> pointRadiusSquareDistance;
+    // 点数は並列にまとめて数え、選択は候補の順に行うのでスレッド数によらず結果は同じ
     float radius = 0.10;
+    vector<int> counts;
+    index.radiusCount(candidates, radius, counts);
 
-    size_t SIZE = cloud->points.size();
+    size_t SIZE = index.getInputCloud()->points.size();
 
-    for(size_t i=0;i<searchPoints->points.size();i++)
+    for(size_t i=0;i<candidates.points.size();i++)
     {
-        PointA searchPoint = searchPoints->points[i];
-        if(kdtree.radiusSearch (searchPoint, radius, pointIdxRadiusSearch, pointRadiusSquareDistance) > 0){
-            if( pointIdxRadiusSearch.size() < SIZE ){
-                centroid = searchPoint;
-                SIZE = pointIdxRadiusSearch.size();
-            }
+        if(0<counts[i] && size_t(counts[i])<SIZE){
+            centroid = candidates.points[i];
+            SIZE = counts[i];
         }
     }
 }
 
-void K_nearest_neighbor_search(int K,
-                               CloudAPtr cloud,
+void neighbors_with_radius_Search(CloudAPtr cloud,
+                                  PointA point,
+                                  CloudAPtr& searchPoints,
+                                  PointA& centroid)
+{
+    SearchIndex index(cloud);
+    neighbors_with_radius_Search(index, point, searchPoints, centroid);
+}
+
+void K_nearest_neighbor_search(const SearchIndex& index,
+                               int K,
                                PointA searchPoint,
                                PointA& output)
 {
@@ -62,25 +154,34 @@ void K_nearest_neighbor_search(int K,
     float Z = searchPoint.z;
 
     // 中心点から最近傍点群を指定サイズ取得し、重心点を円の重心点を算出する
-    pcl::KdTreeFLANN<pcl::PointXYZ> kdtree;
-    kdtree.setInputCloud (cloud);
-
-    std::vector<int> pointIdxNKNSearch(K);
-    std::vector<float> pointNKNSquaredDistance(K);
+    CloudA query;
+    query.points.push_back(searchPoint);
+    vector<vector<int> > pointIdxNKNSearch;
+    index.nearestKSearch(query, K, pointIdxNKNSearch);
 
-    
-    if ( kdtree.nearestKSearch (searchPoint, K, pointIdxNKNSearch, pointNKNSquaredDistance) > 0 )
+    const CloudA& cloud = *index.getInputCloud();
+    const vector<int>& neighbors = pointIdxNKNSearch[0];
+    if ( !neighbors.empty() )
     {
-        for (size_t i = 0; i < pointIdxNKNSearch.size (); ++i)
+        for (size_t i = 0; i < neighbors.size (); ++i)
         {
-            X += cloud->points[ pointIdxNKNSearch[i] ].x;
-            Y += cloud->points[ pointIdxNKNSearch[i] ].y;
-            Z += cloud->points[ pointIdxNKNSearch[i] ].z;
+            X += cloud.points[ neighbors[i] ].x;
+            Y += cloud.points[ neighbors[i] ].y;
+            Z += cloud.points[ neighbors[i] ].z;
         }
-        output.x = X / int(pointIdxNKNSearch.size() + 1);
-        output.y = Y / int(pointIdxNKNSearch.size() + 1);
-        output.z = Z / int(pointIdxNKNSearch.size() + 1);
+        output.x = X / int(neighbors.size() + 1);
+        output.y = Y / int(neighbors.size() + 1);
+        output.z = Z / int(neighbors.size() + 1);
     }
 
     printf("Final Centroid Point ( %.3f %.3f %.3f )\n", output.x, output.y , output.z);
 }
+
+void K_nearest_neighbor_search(int K,
+                               CloudAPtr cloud,
+                               PointA searchPoint,
+                               PointA& output)
+{
+    SearchIndex index(cloud);
+    K_nearest_neighbor_search(index, K, searchPoint, output);
+}
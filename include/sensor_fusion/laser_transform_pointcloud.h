@@ -0,0 +1,78 @@
+#ifndef _LASER_TRANSFORM_POINTCLOUD_H_
+#define _LASER_TRANSFORM_POINTCLOUD_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/tf.h>
+#include <tf/transform_listener.h>
+
+#include <sensor_fusion/pointcloud2_transform.h>
+
+#include <string>
+
+#include "Eigen/Core"
+
+// 点群を target_frame に座標変換する
+// node(src/laser_transform_pointcloud.cpp) と nodelet(src/nodelet/sensor_fusion_nodelets.cpp) で共通
+//
+// PointCloud2 のバイト列のまま x,y,z だけを変換するので、intensity/ring 等のフィールドも残る
+// 出力バッファは購読側が保持していなければ次のスキャンで再利用する
+class PointCloudTransform{
+	private:
+		tf::TransformListener listener;
+		tf::StampedTransform transform;
+		ros::Publisher pub;
+		ros::Subscriber sub;
+		ros::Time t;
+		std::string target_frame;
+
+		sensor_msgs::PointCloud2Ptr output;
+
+	public:
+		PointCloudTransform(ros::NodeHandle nh, ros::NodeHandle pnh);
+		void Callback(const sensor_msgs::PointCloud2ConstPtr& msg);
+};
+
+PointCloudTransform::PointCloudTransform(ros::NodeHandle nh, ros::NodeHandle pnh)
+	: target_frame("centerlaser")
+{
+    pnh.getParam("target_frame", target_frame);
+	sub = nh.subscribe("/cloud", 10, &PointCloudTransform::Callback, this);
+	pub = nh.advertise<sensor_msgs::PointCloud2>("/cloud/tf", 10);
+}
+
+void PointCloudTransform::Callback(const sensor_msgs::PointCloud2ConstPtr &msg){
+	t = msg->header.stamp;
+	std::string source_frame = msg->header.frame_id;
+
+	try{
+		listener.waitForTransform(target_frame.c_str(), source_frame.c_str(), t, ros::Duration(1.0));
+		listener.lookupTransform(target_frame.c_str(), source_frame.c_str(), t, transform);
+	}catch (tf::TransformException& ex) {
+		ROS_WARN("[draw_frames] TF exception:\n%s", ex.what());
+		return;
+	}
+
+	Eigen::Matrix4f matrix = Eigen::Matrix4f::Identity();
+	const tf::Matrix3x3& basis = transform.getBasis();
+	const tf::Vector3& origin = transform.getOrigin();
+	for(int r=0;r<3;r++){
+		for(int c=0;c<3;c++)
+			matrix(r, c) = basis[r][c];
+		matrix(r, 3) = origin[r];
+	}
+
+	// publish済みのバッファを誰かが保持している間は新しく確保する
+	if(!output || !output.unique())
+		output.reset(new sensor_msgs::PointCloud2);
+	*output = *msg;
+
+	if(!transform_pointcloud2(matrix, *output)){
+		ROS_WARN("[laser_transform_pointcloud] no FLOAT32 x/y/z fields in %s", source_frame.c_str());
+		return;
+	}
+	output->header.frame_id = target_frame;
+	pub.publish(output);
+}
+
+#endif
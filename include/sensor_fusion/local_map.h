@@ -0,0 +1,137 @@
+#ifndef _LOCAL_MAP_H_
+#define _LOCAL_MAP_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "Eigen/StdVector"
+
+// 直近 size スキャン分の点群を保持するリングバッファ
+// スキャンごとに別々の点群として持つので、最も古いスキャンの削除はO(1)
+// 1つの点群への結合は concatenate() を呼んだときだけ行う
+//
+// スキャンは取得時の姿勢(odom座標系でのセンサ姿勢)と一緒に保存し、
+// 結合時に各スキャンを「取得時の姿勢 -> 現在の姿勢」の変換1回で現在のセンサ座標系に移す
+// 姿勢が変わっていないスキャンは変換せずにそのままコピーする
+template<typename PointT>
+class LocalMap{
+    public:
+        typedef pcl::PointCloud<PointT> Cloud;
+        typedef typename Cloud::Ptr CloudPtr;
+
+    private:
+        std::vector<CloudPtr> ring;
+        std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > pose;
+        int head;           // 次に書き込むスロット
+        int count;          // 保持しているスキャン数
+        size_t num_points;  // 保持している点数の合計
+
+    public:
+        LocalMap(int size = 1)
+            : head(0), count(0), num_points(0)
+        {
+            setSize(size);
+        }
+
+        // 保持スキャン数を変更する(保持中のスキャンは破棄)
+        void setSize(int size)
+        {
+            if(size<1) size = 1;
+            ring.assign(size, CloudPtr());
+            pose.assign(size, Eigen::Matrix4f::Identity());
+            head = 0;
+            count = 0;
+            num_points = 0;
+        }
+
+        int capacity() const { return int(ring.size()); }
+        int size() const { return count; }
+        size_t points() const { return num_points; }
+
+        // 満杯のときは最も古いスキャンを置き換える
+        void push(const CloudPtr& scan)
+        {
+            push(scan, Eigen::Matrix4f::Identity());
+        }
+
+        void push(const CloudPtr& scan, const Eigen::Matrix4f& scan_pose)
+        {
+            if(count==capacity())
+                num_points -= ring[head]->points.size();
+            else
+                count++;
+
+            ring[head] = scan;
+            pose[head] = scan_pose;
+            num_points += scan->points.size();
+            head = (head+1)%capacity();
+        }
+
+        // 古い順に i 番目のスキャン
+        const CloudPtr& at(int i) const
+        {
+            return ring[(head-count+i+capacity())%capacity()];
+        }
+
+        const Eigen::Matrix4f& poseAt(int i) const
+        {
+            return pose[(head-count+i+capacity())%capacity()];
+        }
+
+        // 姿勢を考慮せずにそのまま結合する
+        void concatenate(Cloud& output) const
+        {
+            output.points.clear();
+            output.points.reserve(num_points);
+            for(int i=0;i<count;i++){
+                const Cloud& scan = *at(i);
+                output.points.insert(output.points.end(), scan.points.begin(), scan.points.end());
+            }
+            output.width = output.points.size();
+            output.height = 1;
+            output.is_dense = false;
+        }
+
+        // current_pose のセンサ座標系に動き補償して結合する
+        void concatenate(Cloud& output, const Eigen::Matrix4f& current_pose) const
+        {
+            const Eigen::Matrix4f inverse_pose = current_pose.inverse();
+
+            output.points.resize(num_points);
+            size_t offset = 0;
+            for(int i=0;i<count;i++){
+                const Cloud& scan = *at(i);
+                const int size = int(scan.points.size());
+                PointT* out = output.points.data() + offset;
+                offset += size;
+
+                const Eigen::Matrix4f relative = inverse_pose*poseAt(i);
+                if(relative.isIdentity(1e-6f)){
+                    std::copy(scan.points.begin(), scan.points.end(), out);
+                    continue;
+                }
+
+                const Eigen::Matrix3f R = relative.topLeftCorner<3, 3>();
+                const Eigen::Vector3f t = relative.topRightCorner<3, 1>();
+#pragma omp parallel for schedule(static)
+                for(int j=0;j<size;j++){
+                    const PointT& p = scan.points[j];
+                    Eigen::Vector3f q = R*Eigen::Vector3f(p.x, p.y, p.z) + t;
+                    out[j] = p;
+                    out[j].x = q[0];
+                    out[j].y = q[1];
+                    out[j].z = q[2];
+                }
+            }
+            output.width = output.points.size();
+            output.height = 1;
+            output.is_dense = false;
+        }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef _NORMAL_ESTIMATION_H_
+#define _NORMAL_ESTIMATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/io.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "Eigen/Core"
+#include "Eigen/Eigenvalues"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// 半径近傍グラフ
+// 点 i の近傍は begin(i) ~ end(i)-1 (自分自身を含む, 近い順)
+//
+// 近傍は各スレッドが書いた固定長のチャンクに置いたまま使い、1本の配列にまとめ直さない
+// (まとめ直すとコピーの間だけグラフを2重に持つので、ピークのメモリが倍になる)
+// start はチャンクの中を指すので、コピーはできない (ムーブはできる)
+struct NeighborGraph{
+    std::vector<std::vector<int> > chunks;
+    std::vector<const int*> start;
+    std::vector<int> counts;
+
+    NeighborGraph() = default;
+    NeighborGraph(NeighborGraph&&) = default;
+    NeighborGraph& operator=(NeighborGraph&&) = default;
+    NeighborGraph(const NeighborGraph&) = delete;
+    NeighborGraph& operator=(const NeighborGraph&) = delete;
+
+    // 近傍を書き込むチャンクの大きさ [int] (4MB)
+    // 1点の近傍がチャンクの残りに入らなければ新しいチャンクにするので、無駄はスレッドあたりチャンク1つ程度
+    static size_t chunk_size(){ return size_t(1) << 20; }
+
+    int size() const { return int(counts.size()); }
+    int count(int i) const { return counts[i]; }
+    const int* begin(int i) const { return start[i]; }
+    const int* end(int i) const { return start[i] + counts[i]; }
+};
+
+// KdTreeを1回作り、全点の半径 radius 内の近傍を並列に求める
+// max_neighbors > 0 なら近い順にその数まで
+//
+// 各スレッドが連続した区間を担当し、近傍を自分のチャンクに書いて、その位置を start に残す
+template<typename PointT>
+void build_neighbor_graph(const typename pcl::PointCloud<PointT>::ConstPtr& cloud,
+                          float radius,
+                          NeighborGraph& graph,
+                          int max_neighbors = 0)
+{
+    const int size = int(cloud->points.size());
+    graph.chunks.clear();
+    graph.start.assign(size, NULL);
+    graph.counts.assign(size, 0);
+    if(size==0) return;
+
+    pcl::KdTreeFLANN<PointT> kdtree;
+    kdtree.setInputCloud(cloud);
+
+#pragma omp parallel
+    {
+        int tid = 0;
+        int num = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        num = omp_get_num_threads();
+#endif
+        const int begin = int((long long)size*tid/num);
+        const int end   = int((long long)size*(tid+1)/num);
+
+        std::vector<std::vector<int> > local;
+        std::vector<int> indices;
+        std::vector<float> distances;
+        for(int i=begin;i<end;i++){
+            const PointT& p = cloud->points[i];
+            int found = 0;
+            if(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))
+                found = kdtree.radiusSearch(p, radius, indices, distances, (unsigned int)max_neighbors);
+            graph.counts[i] = found;
+            if(found==0) continue;
+
+            // 容量の範囲で足すだけなので、チャンクが再確保されて start が無効になることはない
+            if(local.empty() || local.back().capacity() - local.back().size() < size_t(found)){
+                local.push_back(std::vector<int>());
+                local.back().reserve(std::max(NeighborGraph::chunk_size(), size_t(found)));
+            }
+            std::vector<int>& chunk = local.back();
+            graph.start[i] = chunk.data() + chunk.size();
+            chunk.insert(chunk.end(), indices.begin(), indices.begin() + found);
+        }
+
+        // ムーブなのでチャンクの中身は動かない
+#pragma omp critical
+        for(size_t k=0;k<local.size();k++)
+            graph.chunks.push_back(std::move(local[k]));
+    }
+}
+
+// 点数 n と、同じ基準点からの差で取った和 sum, 二乗和 sum_sq から法線と曲率を求める
+// 共分散の最小固有値の固有ベクトルを法線, λ0/(λ0+λ1+λ2) を曲率とする (pcl::NormalEstimation と同じ定義)
+// sum_sq/n - mean*mean^T は丸めで λ0 がわずかに負になることがあるので、λ0 は0で止める
+// 法線は viewpoint (注目点から視点へのベクトル) の側に向ける
+// (cluster_stats.h, voxel_normal_map.h もこれを使う)
+inline void normal_from_moments(double n,
+                                const Eigen::Vector3d& sum,
+                                const Eigen::Matrix3d& sum_sq,
+                                const Eigen::Vector3f& viewpoint,
+                                Eigen::Vector3f& normal,
+                                float& curvature)
+{
+    const Eigen::Vector3d mean = sum/n;
+    const Eigen::Matrix3d cov = sum_sq/n - mean*mean.transpose();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+    solver.computeDirect(cov);
+    const Eigen::Vector3d eigenvalues = solver.eigenvalues();
+    const double trace = eigenvalues.sum();
+
+    normal = solver.eigenvectors().col(0).cast<float>();
+    if(normal.dot(viewpoint)<0.0f) normal = -normal;
+    curvature = (0.0<trace) ? float(std::max(eigenvalues[0], 0.0)/trace) : 0.0f;
+}
+
+// 点 i の近傍から法線と曲率を求める (定義は normal_from_moments())
+// 法線は viewpoint 側に向ける
+// 近傍が3点未満の点は法線, 曲率とも0にする (NaNにはしない)
+template<typename PointT>
+inline void compute_normal(const pcl::PointCloud<PointT>& cloud,
+                           const NeighborGraph& graph,
+                           int i,
+                           const Eigen::Vector3f& viewpoint,
+                           Eigen::Vector3f& normal,
+                           float& curvature)
+{
+    normal.setZero();
+    curvature = 0.0f;
+    const int n = graph.count(i);
+    if(n<3) return;
+
+    // 桁落ちしないよう注目点からの差で和を取る
+    const Eigen::Vector3d origin = cloud.points[i].getVector3fMap().template cast<double>();
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+    for(const int* it=graph.begin(i);it!=graph.end(i);++it){
+        const Eigen::Vector3d d = cloud.points[*it].getVector3fMap().template cast<double>() - origin;
+        sum += d;
+        sum_sq.noalias() += d*d.transpose();
+    }
+    normal_from_moments(n, sum, sum_sq, viewpoint - cloud.points[i].getVector3fMap(), normal, curvature);
+}
+
+// 近傍グラフから全点の法線を並列に求め、確保済みの出力に書き込む
+// 出力は入力と同じ並び・同じ点数で、法線以外のフィールド (xyz, rgb) は入力からコピーする
+template<typename PointInT, typename PointOutT>
+void estimate_normals(const pcl::PointCloud<PointInT>& cloud,
+                      const NeighborGraph& graph,
+                      pcl::PointCloud<PointOutT>& output,
+                      const Eigen::Vector3f& viewpoint = Eigen::Vector3f::Zero())
+{
+    const int size = int(cloud.points.size());
+    output.header = cloud.header;
+    output.points.resize(size);
+    output.width = size;
+    output.height = 1;
+    output.is_dense = cloud.is_dense;
+
+#pragma omp parallel for schedule(dynamic, 256)
+    for(int i=0;i<size;i++){
+        PointOutT& p = output.points[i];
+        pcl::copyPoint(cloud.points[i], p);
+
+        Eigen::Vector3f normal;
+        float curvature;
+        compute_normal(cloud, graph, i, viewpoint, normal, curvature);
+        p.normal_x = normal[0];
+        p.normal_y = normal[1];
+        p.normal_z = normal[2];
+        p.curvature = curvature;
+    }
+}
+
+#endif
@@ -3,16 +3,189 @@
 #include <pcl/point_types.h>
 #include <pcl/filters/statistical_outlier_removal.h>
 
+#include <sensor_fusion/point_kernels.h>
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
 typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 
+// 統計的外れ値除去 (StatisticalOutlierRemoval) のボクセル近似
+//
+// StatisticalOutlierRemoval は点ごとに k近傍の平均距離を求め、その分布の 平均 + mul*標準偏差 を
+// 超える点を外れ値とする。k近傍探索が O(N k log N) で、ノードの点群を貯めたものには重すぎる
+//
+// ここでは点を leaf_size のボクセルに分け、周囲 3x3x3 ボクセルの点数から密度を求めて
+// k近傍の平均距離を見積もる (同じボクセルの点は同じ値になる)
+// 見積もった値の分布に同じ閾値を適用するので、パラメータの意味は StatisticalOutlierRemoval と同じ
+//
+// 点数が exact_threshold 以下のときは StatisticalOutlierRemoval をそのまま使う
+class VoxelOutlierRemoval{
+    private:
+        float leaf_size;
+        int mean_k;
+        double stddev_mul;
+        int exact_threshold;
+
+        // 周囲 27 ボクセル (一辺 3*leaf_size の立方体) に count 点があるとき、
+        // 一様な密度なら k近傍は半径 r = leaf * cbrt(81k / (4π count)) の球に入り、その平均距離は 3r/4
+        double meanDistance(int count) const
+        {
+            return 0.75*leaf_size*std::cbrt(81.0*mean_k/(4.0*M_PI*count));
+        }
+
+        // ボクセル座標を 21bit ずつ詰めたキー
+        static uint64_t key(int x, int y, int z)
+        {
+            return (uint64_t(x) << 42) | (uint64_t(y) << 21) | uint64_t(z);
+        }
+
+    public:
+        VoxelOutlierRemoval()
+            : leaf_size(0.1f), mean_k(100), stddev_mul(1.0), exact_threshold(50000) {}
+
+        void setLeafSize(float leaf_size_){ leaf_size = leaf_size_; }
+        void setMeanK(int k){ mean_k = k; }
+        void setStddevMulThresh(double mul){ stddev_mul = mul; }
+        void setExactThreshold(int size){ exact_threshold = size; }
+
+        // 残す点のindex (入力順)
+        template<typename PointT>
+        void filter(const typename pcl::PointCloud<PointT>::Ptr& cloud, std::vector<int>& indices);
+};
+
+template<typename PointT>
+void VoxelOutlierRemoval::filter(const typename pcl::PointCloud<PointT>::Ptr& cloud, std::vector<int>& indices)
+{
+    const int size = int(cloud->points.size());
+    indices.clear();
+    if(size==0) return;
+
+    // 点数が少なければ厳密に求める
+    if(size<=exact_threshold){
+        pcl::StatisticalOutlierRemoval<PointT> sor;
+        sor.setInputCloud(cloud);
+        sor.setMeanK(mean_k);
+        sor.setStddevMulThresh(stddev_mul);
+        sor.filter(indices);
+        return;
+    }
+
+    // 範囲
+    float min_x =  std::numeric_limits<float>::max();
+    float min_y =  std::numeric_limits<float>::max();
+    float min_z =  std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_y = -std::numeric_limits<float>::max();
+    float max_z = -std::numeric_limits<float>::max();
+#pragma omp parallel for reduction(min:min_x,min_y,min_z) reduction(max:max_x,max_y,max_z)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud->points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        min_x = std::min(min_x, p.x); max_x = std::max(max_x, p.x);
+        min_y = std::min(min_y, p.y); max_y = std::max(max_y, p.y);
+        min_z = std::min(min_z, p.z); max_z = std::max(max_z, p.z);
+    }
+    if(max_x<min_x) return;
+
+    // 1軸 2^21 ボクセルに収まるようにする (周囲を見るので両端に1つずつ余白を取る)
+    const float span = std::max(max_x-min_x, std::max(max_y-min_y, max_z-min_z));
+    const float leaf = std::max(leaf_size, span/float((1 << 21) - 3));
+    const float inv_leaf = 1.0f/leaf;
+
+    // 点 -> (ボクセルのキー, 点のindex) を作ってキーでソートする
+    const uint64_t invalid = ~uint64_t(0);
+    std::vector<std::pair<uint64_t, int> > order(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud->points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)){
+            order[i] = std::make_pair(invalid, i);
+            continue;
+        }
+        const int x = int((p.x-min_x)*inv_leaf) + 1;
+        const int y = int((p.y-min_y)*inv_leaf) + 1;
+        const int z = int((p.z-min_z)*inv_leaf) + 1;
+        order[i] = std::make_pair(key(x, y, z), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    // 占有ボクセルと点数
+    std::vector<uint64_t> voxels;
+    std::vector<int> begin;
+    for(int i=0;i<size && order[i].first!=invalid;i++){
+        if(voxels.empty() || voxels.back()!=order[i].first){
+            voxels.push_back(order[i].first);
+            begin.push_back(i);
+        }
+    }
+    const int num_voxels = int(voxels.size());
+    begin.push_back(num_voxels ? int(std::lower_bound(order.begin(), order.end(), std::make_pair(invalid, 0)) - order.begin()) : 0);
+
+    // ボクセルごとの k近傍平均距離の見積もり
+    std::vector<double> distance(num_voxels);
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+#pragma omp parallel for schedule(static)
+    for(int v=0;v<num_voxels;v++){
+        const int x = int(voxels[v] >> 42);
+        const int y = int((voxels[v] >> 21) & mask);
+        const int z = int(voxels[v] & mask);
+        int count = 0;
+        for(int dx=-1;dx<=1;dx++){
+            for(int dy=-1;dy<=1;dy++){
+                for(int dz=-1;dz<=1;dz++){
+                    const uint64_t k = key(x+dx, y+dy, z+dz);
+                    std::vector<uint64_t>::const_iterator it = std::lower_bound(voxels.begin(), voxels.end(), k);
+                    if(it!=voxels.end() && *it==k){
+                        const int n = int(it - voxels.begin());
+                        count += begin[n+1] - begin[n];
+                    }
+                }
+            }
+        }
+        // 自分自身を除いた近傍点数
+        distance[v] = meanDistance(std::max(count-1, 1));
+    }
+
+    // 点ごとの値の平均と標準偏差 (同じボクセルの点は同じ値なので点数で重み付けする)
+    double sum = 0.0, sum_sq = 0.0;
+    int valid = 0;
+#pragma omp parallel for reduction(+:sum,sum_sq,valid)
+    for(int v=0;v<num_voxels;v++){
+        const int n = begin[v+1] - begin[v];
+        sum += n*distance[v];
+        sum_sq += n*distance[v]*distance[v];
+        valid += n;
+    }
+    const double mean = sum/valid;
+    const double stddev = std::sqrt(std::max(0.0, (sum_sq - sum*mean)/std::max(valid-1, 1)));
+    const double threshold = mean + stddev_mul*stddev;
+
+    // 閾値以下のボクセルの点を入力順に残す
+    std::vector<int> keep(size, -1);
+#pragma omp parallel for schedule(static)
+    for(int v=0;v<num_voxels;v++){
+        if(threshold<distance[v]) continue;
+        for(int i=begin[v];i<begin[v+1];i++)
+            keep[order[i].second] = 0;
+    }
+    mask_to_indices(keep, indices);
+}
+
 void outlier_removal(CloudAPtr cloud, CloudAPtr& cloud_filtered)
 {
     // Create the filtering object
-    pcl::StatisticalOutlierRemoval<pcl::PointXYZ> sor;
-    sor.setInputCloud (cloud);
+    VoxelOutlierRemoval sor;
     sor.setMeanK (100);
     sor.setStddevMulThresh (1.0);
-    sor.filter (*cloud_filtered);
+
+    std::vector<int> indices;
+    sor.filter<PointA> (cloud, indices);
+    copy_points(*cloud, indices, *cloud_filtered);
 }
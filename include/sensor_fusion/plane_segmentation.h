@@ -1,12 +1,16 @@
 #include <pcl/point_types.h>
 #include <pcl_ros/point_cloud.h>
 #include <iostream>
-#include <pcl/ModelCoefficients.h>
-#include <pcl/io/pcd_io.h>
-#include <pcl/point_types.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/segmentation/sac_segmentation.h>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdint.h>
+
+#include <sensor_fusion/point_kernels.h>
+
+#include "Eigen/Core"
+#include "Eigen/Eigenvalues"
 
 using namespace Eigen;
 
@@ -14,36 +18,243 @@ typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 
+// splitmix64 : state を進めて64bitの乱数を返す
+// 連番の seed から作っても出力の相関がないので、仮説ごとに独立な乱数列を作るのに使う
+inline uint64_t splitmix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// 平面 n・p + d = 0 (|n| = 1) とその inlier (入力点群のindex)
+struct PlaneModel{
+    Vector4f coefficients;
+    std::vector<int> inliers;
+};
+
+// RANSACによる複数平面の抽出
+// 最も点数の多い平面から順に、inlierを取り除きながら最大 max_planes 枚を求める
+//
+// - 仮説(3点)はまとめて生成し、各仮説の inlier 数を並列に数える
+//   (残りの点の座標は配列に詰め直してあるので、数えるループはSIMD化される)
+// - 最良仮説の inlier 率から必要な試行回数を見積もり、それを超えたら打ち切る
+// - 最良仮説の inlier から最小二乗で平面を求め直し、inlier を取り直す
+// - k 枚目の平面の仮説 i の乱数は (seed, k, i) だけで決まるので、スレッド数によらず結果は同じ
+class MultiPlaneSegmentation{
+    private:
+        float distance_threshold;
+        int max_planes;
+        int min_inliers;
+        int max_iterations;
+        double probability;
+        unsigned int seed;
+
+        // 残りの点 (SoA)
+        std::vector<float> x, y, z;
+        std::vector<int> index;
+
+        // k 枚目の平面の iteration 番目の仮説 : 3点から平面を作る (一直線上なら false)
+        bool hypothesis(int k, int iteration, Vector4f& plane) const
+        {
+            int sample[3];
+            sampleIndices(k, iteration, int(index.size()), sample);
+            const int a = sample[0];
+            const int b = sample[1];
+            const int c = sample[2];
+            if(a==b || b==c || a==c) return false;
+
+            const Vector3f pa(x[a], y[a], z[a]);
+            const Vector3f pb(x[b], y[b], z[b]);
+            const Vector3f pc(x[c], y[c], z[c]);
+            Vector3f n = (pb-pa).cross(pc-pa);
+            const float norm = n.norm();
+            if(norm<=std::numeric_limits<float>::epsilon()) return false;
+            n /= norm;
+            plane << n, -n.dot(pa);
+            return true;
+        }
+
+        int countInliers(const Vector4f& plane) const
+        {
+            const int size = int(index.size());
+            const float a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+            const float th = distance_threshold;
+            const float* px = x.data();
+            const float* py = y.data();
+            const float* pz = z.data();
+            int count = 0;
+#pragma omp simd reduction(+:count)
+            for(int i=0;i<size;i++)
+                count += (std::fabs(a*px[i] + b*py[i] + c*pz[i] + d)<=th);
+            return count;
+        }
+
+        // 残りの点のうち plane から threshold 以内の点の位置 (x,y,z 配列上)
+        void inlierPositions(const Vector4f& plane, std::vector<int>& positions) const
+        {
+            const int size = int(index.size());
+            std::vector<int> mask(size);
+#pragma omp parallel for simd schedule(static)
+            for(int i=0;i<size;i++)
+                mask[i] = (std::fabs(plane[0]*x[i] + plane[1]*y[i] + plane[2]*z[i] + plane[3])<=distance_threshold) - 1;
+            mask_to_indices(mask, positions);
+        }
+
+        // inlier に最小二乗で平面を当てはめ直す (共分散の最小固有値の固有ベクトルが法線)
+        void refine(const std::vector<int>& positions, Vector4f& plane) const
+        {
+            if(positions.size()<3) return;
+            Vector3d mean = Vector3d::Zero();
+            for(size_t i=0;i<positions.size();i++)
+                mean += Vector3d(x[positions[i]], y[positions[i]], z[positions[i]]);
+            mean /= double(positions.size());
+
+            Matrix3d cov = Matrix3d::Zero();
+            for(size_t i=0;i<positions.size();i++){
+                const Vector3d d = Vector3d(x[positions[i]], y[positions[i]], z[positions[i]]) - mean;
+                cov.noalias() += d*d.transpose();
+            }
+
+            SelfAdjointEigenSolver<Matrix3d> solver;
+            solver.computeDirect(cov);
+            Vector3d n = solver.eigenvectors().col(0);
+            // 向きは元の仮説に合わせる
+            if(n.cast<float>().dot(plane.head<3>())<0.0f) n = -n;
+            plane << n.cast<float>(), float(-n.dot(mean));
+        }
+
+    public:
+        MultiPlaneSegmentation()
+            : distance_threshold(0.03f), max_planes(1), min_inliers(3),
+              max_iterations(1000), probability(0.99), seed(1) {}
+
+        void setDistanceThreshold(float threshold){ distance_threshold = threshold; }
+        void setMaxPlanes(int planes){ max_planes = planes; }
+        void setMinInliers(int inliers){ min_inliers = inliers; }
+        void setMaxIterations(int iterations){ max_iterations = iterations; }
+        void setProbability(double probability_){ probability = probability_; }
+        void setSeed(unsigned int seed_){ seed = seed_; }
+
+        // k 枚目の平面の iteration 番目の仮説で選ぶ3点 ([0, size) の位置, 重複することもある)
+        // (seed, k, iteration) を splitmix64 で順に混ぜて状態を作るので、隣り合う仮説でも選ぶ点に偏りが出ない
+        // 乱数の上位32bitを [0, size) に写す
+        void sampleIndices(int k, int iteration, int size, int sample[3]) const
+        {
+            uint64_t state = seed;
+            state = splitmix64(state) ^ uint64_t(k);
+            state = splitmix64(state) ^ uint64_t(iteration);
+            for(int j=0;j<3;j++)
+                sample[j] = int(((splitmix64(state) >> 32)*uint64_t(size)) >> 32);
+        }
+
+        template<typename PointT>
+        void segment(const pcl::PointCloud<PointT>& cloud, std::vector<PlaneModel>& planes);
+};
+
+template<typename PointT>
+void MultiPlaneSegmentation::segment(const pcl::PointCloud<PointT>& cloud, std::vector<PlaneModel>& planes)
+{
+    planes.clear();
+
+    // 有限な点だけを残りの点とする
+    x.clear(); y.clear(); z.clear(); index.clear();
+    for(size_t i=0;i<cloud.points.size();i++){
+        const PointT& p = cloud.points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        x.push_back(p.x);
+        y.push_back(p.y);
+        z.push_back(p.z);
+        index.push_back(int(i));
+    }
+
+    // 1回にまとめて評価する仮説の数 (打ち切りの判定はこの単位で行う)
+    // スレッド数に依存させると打ち切る位置が変わり結果も変わるので固定にする
+    const int batch = 64;
+
+    for(int k=0;k<max_planes;k++){
+        const int size = int(index.size());
+        if(size<std::max(3, min_inliers)) break;
+
+        Vector4f best_plane = Vector4f::Zero();
+        int best_count = 0;
+        int best_iteration = -1;
+        double required = max_iterations;
+
+        std::vector<Vector4f> batch_plane(batch);
+        std::vector<int> batch_count(batch);
+        for(int begin=0;begin<max_iterations && begin<required;begin+=batch){
+            const int end = std::min(begin+batch, max_iterations);
+#pragma omp parallel for schedule(dynamic, 1)
+            for(int it=begin;it<end;it++){
+                Vector4f plane = Vector4f::Zero();
+                batch_count[it-begin] = hypothesis(k, it, plane) ? countInliers(plane) : -1;
+                batch_plane[it-begin] = plane;
+            }
+            // 同数なら先の仮説を選ぶ
+            for(int it=begin;it<end;it++){
+                if(best_count<batch_count[it-begin]){
+                    best_count = batch_count[it-begin];
+                    best_plane = batch_plane[it-begin];
+                    best_iteration = it;
+                }
+            }
+
+            // 3点とも inlier を引く確率 w^3 から、probability で見つかるのに必要な試行回数
+            if(0<best_count){
+                const double w = double(best_count)/size;
+                const double all = std::pow(w, 3.0);
+                if(1.0-1e-12<=all) required = 0;
+                else required = std::log(1.0-probability)/std::log(1.0-all);
+            }
+        }
+        if(best_iteration<0 || best_count<min_inliers) break;
+
+        std::vector<int> positions;
+        inlierPositions(best_plane, positions);
+        refine(positions, best_plane);
+        inlierPositions(best_plane, positions);
+        if(int(positions.size())<min_inliers) break;
+
+        PlaneModel model;
+        model.coefficients = best_plane;
+        model.inliers.resize(positions.size());
+        for(size_t i=0;i<positions.size();i++)
+            model.inliers[i] = index[positions[i]];
+        planes.push_back(model);
+
+        // inlier を残りの点から取り除く
+        std::vector<char> removed(size, 0);
+        for(size_t i=0;i<positions.size();i++) removed[positions[i]] = 1;
+        int n = 0;
+        for(int i=0;i<size;i++){
+            if(removed[i]) continue;
+            x[n] = x[i]; y[n] = y[i]; z[n] = z[i]; index[n] = index[i];
+            n++;
+        }
+        x.resize(n); y.resize(n); z.resize(n); index.resize(n);
+    }
+}
+
 void plane_segmentation(CloudAPtr cloud, CloudAPtr& plane, float distance)
 {
-    pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
-    pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
-    // Create the segmentation object
-    pcl::SACSegmentation<pcl::PointXYZ> seg;
-    // Optional
-    seg.setOptimizeCoefficients (true);
-    // Mandatory
-    seg.setModelType (pcl::SACMODEL_PLANE);
-    seg.setMethodType (pcl::SAC_RANSAC);
-    seg.setDistanceThreshold (distance);
-
-    seg.setInputCloud (cloud);
-    seg.segment (*inliers, *coefficients);
-
-    if (inliers->indices.size () == 0)
+    MultiPlaneSegmentation seg;
+    seg.setDistanceThreshold(distance);
+    seg.setMaxPlanes(1);
+
+    std::vector<PlaneModel> planes;
+    seg.segment(*cloud, planes);
+
+    if (planes.empty())
     {
         PCL_ERROR ("Could not estimate a planar model for the given dataset.");
+        plane->points.clear();
+        return;
     }
-    
-    // std::cerr << "Model coefficients: " << coefficients->values[0] << " " 
-    //     << coefficients->values[1] << " "
-    //     << coefficients->values[2] << " " 
-    //     << coefficients->values[3] << std::endl;
-    
+
+    // std::cerr << "Model coefficients: " << planes[0].coefficients.transpose() << std::endl;
+
     // plane pointcloud
-    plane->points.resize(inliers->indices.size());
-    for(size_t i=0;i<inliers->indices.size();i++)
-    {
-        plane->points[i] = cloud->points[inliers->indices[i]];
-    }
+    copy_points(*cloud, planes[0].inliers, *plane);
 }
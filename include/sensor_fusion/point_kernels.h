@@ -0,0 +1,202 @@
+#ifndef _POINT_KERNELS_H_
+#define _POINT_KERNELS_H_
+
+#include <sensor_msgs/CameraInfo.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/index_partition.h>
+
+#include <vector>
+#include <cmath>
+
+#include "Eigen/Core"
+
+// 点群に対する基本処理(距離フィルタ, 箱型クロップ, 視錐台カリング, 座標変換)
+// どの点型でも使えるようにテンプレートにしてある
+//
+// フィルタ系は点群をコピーせず、残す点のindexリスト(入力順)を返す
+// 判定はsqrtを使わず二乗距離で行い、1点ずつ独立な比較だけのループにしてSIMD化させる
+// 点群が必要なら copy_points() で一度だけ確保してコピーする
+
+// 距離計算に使う軸をコンパイル時に選ぶ
+struct FieldsXYZ{
+    template<typename PointT>
+    static float squaredNorm(const PointT& p){ return p.x*p.x + p.y*p.y + p.z*p.z; }
+};
+
+// 水平距離(z を無視)
+struct FieldsXY{
+    template<typename PointT>
+    static float squaredNorm(const PointT& p){ return p.x*p.x + p.y*p.y; }
+};
+
+// mask[i] == 0 の点のindexを入力順に並べる (-1 は捨てる)
+inline void mask_to_indices(const std::vector<int>& mask, std::vector<int>& indices)
+{
+    std::vector<std::vector<int> > output;
+    partition_indices(mask, 1, output);
+    indices.swap(output[0]);
+}
+
+// min_range < 距離 < max_range の点を残す (min_range <= 0 なら下限なし)
+template<typename Fields, typename PointT>
+void range_filter(const pcl::PointCloud<PointT>& cloud,
+                  float min_range, float max_range,
+                  std::vector<int>& indices)
+{
+    const int size = int(cloud.points.size());
+    const float lower = (0.0f<min_range) ? min_range*min_range : -1.0f;
+    const float upper = max_range*max_range;
+
+    // 0 : 残す, -1 : 捨てる (NaNは比較がfalseになるので捨てる)
+    std::vector<int> mask(size);
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const float d = Fields::squaredNorm(cloud.points[i]);
+        mask[i] = ((lower<d) & (d<upper)) - 1;
+    }
+    mask_to_indices(mask, indices);
+}
+
+template<typename PointT>
+void range_filter(const pcl::PointCloud<PointT>& cloud,
+                  float min_range, float max_range,
+                  std::vector<int>& indices)
+{
+    range_filter<FieldsXYZ>(cloud, min_range, max_range, indices);
+}
+
+// min <= (x,y,z) <= max の点を残す
+template<typename PointT>
+void box_crop(const pcl::PointCloud<PointT>& cloud,
+              const Eigen::Vector3f& min, const Eigen::Vector3f& max,
+              std::vector<int>& indices)
+{
+    const int size = int(cloud.points.size());
+    const float min_x = min[0], min_y = min[1], min_z = min[2];
+    const float max_x = max[0], max_y = max[1], max_z = max[2];
+
+    std::vector<int> mask(size);
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud.points[i];
+        mask[i] = ((min_x<=p.x) & (p.x<=max_x)
+                 & (min_y<=p.y) & (p.y<=max_y)
+                 & (min_z<=p.z) & (p.z<=max_z)) - 1;
+    }
+    mask_to_indices(mask, indices);
+}
+
+// LiDAR座標系(x:前, y:左, z:上)の点を画像座標に投影する3x4行列
+// camera_info の P に光学座標系(x:右, y:下, z:前)への軸の入れ替えを掛けたもの
+// (u, v, w) = M * (x, y, z, 1) として u/w, v/w が画素位置, w が奥行き
+inline Eigen::Matrix<float, 3, 4> laser_to_image_projection(const sensor_msgs::CameraInfo& cinfo)
+{
+    Eigen::Matrix<float, 3, 4> P;
+    for(int r=0;r<3;r++)
+        for(int c=0;c<4;c++)
+            P(r, c) = float(cinfo.P[4*r+c]);
+
+    Eigen::Matrix4f axes = Eigen::Matrix4f::Zero();
+    axes(0, 1) = -1.0f;   // x_cv = -y
+    axes(1, 2) = -1.0f;   // y_cv = -z
+    axes(2, 0) =  1.0f;   // z_cv =  x
+    axes(3, 3) =  1.0f;
+    return P*axes;
+}
+
+// カメラの視錐台に入る点を残す
+// projection は camera_info の P (3x4) とカメラ座標系への変換を掛けたもの
+// near < 奥行き < far かつ 0 <= u < width, 0 <= v < height の点が対象
+template<typename PointT>
+void frustum_cull(const pcl::PointCloud<PointT>& cloud,
+                  const Eigen::Matrix<float, 3, 4>& projection,
+                  int width, int height,
+                  float near, float far,
+                  std::vector<int>& indices)
+{
+    const int size = int(cloud.points.size());
+    const Eigen::Matrix<float, 3, 4> P = projection;
+    const float w = float(width);
+    const float h = float(height);
+
+    // u = a/c, v = b/c の判定を除算なしで行う (c > near > 0 が前提)
+    std::vector<int> mask(size);
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud.points[i];
+        const float a = P(0,0)*p.x + P(0,1)*p.y + P(0,2)*p.z + P(0,3);
+        const float b = P(1,0)*p.x + P(1,1)*p.y + P(1,2)*p.z + P(1,3);
+        const float c = P(2,0)*p.x + P(2,1)*p.y + P(2,2)*p.z + P(2,3);
+        mask[i] = ((near<c) & (c<far)
+                 & (0.0f<=a) & (a<w*c)
+                 & (0.0f<=b) & (b<h*c)) - 1;
+    }
+    mask_to_indices(mask, indices);
+}
+
+// 全点を transform で座標変換する (x,y,z以外のフィールドはそのまま)
+// output に cloud 自身を渡してもよい
+template<typename PointT>
+void transform_points(const pcl::PointCloud<PointT>& cloud,
+                      const Eigen::Matrix4f& transform,
+                      pcl::PointCloud<PointT>& output)
+{
+    const int size = int(cloud.points.size());
+    const Eigen::Matrix3f R = transform.topLeftCorner<3, 3>();
+    const Eigen::Vector3f t = transform.topRightCorner<3, 1>();
+
+    if(&output!=&cloud){
+        output.header = cloud.header;
+        output.points.resize(size);
+        output.width = cloud.width;
+        output.height = cloud.height;
+        output.is_dense = cloud.is_dense;
+    }
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud.points[i];
+        Eigen::Vector3f q = R*Eigen::Vector3f(p.x, p.y, p.z) + t;
+        if(&output!=&cloud) output.points[i] = p;
+        output.points[i].x = q[0];
+        output.points[i].y = q[1];
+        output.points[i].z = q[2];
+    }
+}
+
+// indices の点だけを output にコピーする(出力は一度だけ確保する)
+template<typename PointT>
+void copy_points(const pcl::PointCloud<PointT>& cloud,
+                 const std::vector<int>& indices,
+                 pcl::PointCloud<PointT>& output)
+{
+    const int size = int(indices.size());
+
+    output.header = cloud.header;
+    output.points.resize(size);
+    output.width = size;
+    output.height = 1;
+    output.is_dense = cloud.is_dense;
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++)
+        output.points[i] = cloud.points[indices[i]];
+}
+
+// 点ごとの付加情報(時刻など)を indices に合わせて詰める
+template<typename T>
+void copy_values(const std::vector<T>& values,
+                 const std::vector<int>& indices,
+                 std::vector<T>& output)
+{
+    const int size = int(indices.size());
+    output.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++)
+        output[i] = values[indices[i]];
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _POINTCLOUD2_TRANSFORM_H_
+#define _POINTCLOUD2_TRANSFORM_H_
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <cstring>
+#include <string>
+
+#include "Eigen/Core"
+
+// PointCloud2 のバイト列上で x,y,z フィールドだけをその場で座標変換する
+// pcl::PointCloud や sensor_msgs::PointCloud を経由しないので、
+// intensity や ring など他のフィールドはそのまま残り、変換のための確保も発生しない
+
+// FLOAT32 の x,y,z フィールドのoffsetを探す(見つからなければfalse)
+inline bool find_xyz_offsets(const sensor_msgs::PointCloud2& cloud, int& x, int& y, int& z)
+{
+    x = y = z = -1;
+    for(size_t f=0;f<cloud.fields.size();f++){
+        const sensor_msgs::PointField& field = cloud.fields[f];
+        if(field.datatype!=sensor_msgs::PointField::FLOAT32) continue;
+        if(field.name=="x") x = field.offset;
+        else if(field.name=="y") y = field.offset;
+        else if(field.name=="z") z = field.offset;
+    }
+    return 0<=x && 0<=y && 0<=z;
+}
+
+// transform(4x4同次変換行列)を cloud の全点に適用する
+// row_step のパディングがある組織化点群にも対応する
+inline bool transform_pointcloud2(const Eigen::Matrix4f& transform, sensor_msgs::PointCloud2& cloud)
+{
+    int x, y, z;
+    if(!find_xyz_offsets(cloud, x, y, z)) return false;
+
+    const int width = int(cloud.width);
+    const int size = width*int(cloud.height);
+    const uint32_t point_step = cloud.point_step;
+    const uint32_t row_step = cloud.row_step;
+    uint8_t* data = cloud.data.data();
+
+    // x,y,z が連続していれば12byteをまとめて読み書きする
+    const bool packed = (y==x+4 && z==x+8);
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        uint8_t* p = data + size_t(i/width)*row_step + size_t(i%width)*point_step;
+
+        // 4x4の固定サイズ積はEigenがSSEでベクトル化する
+        Eigen::Vector4f v(0.0f, 0.0f, 0.0f, 1.0f);
+        if(packed){
+            std::memcpy(v.data(), p+x, 3*sizeof(float));
+        }
+        else{
+            std::memcpy(&v[0], p+x, sizeof(float));
+            std::memcpy(&v[1], p+y, sizeof(float));
+            std::memcpy(&v[2], p+z, sizeof(float));
+        }
+
+        const Eigen::Vector4f q = transform*v;
+
+        if(packed){
+            std::memcpy(p+x, q.data(), 3*sizeof(float));
+        }
+        else{
+            std::memcpy(p+x, &q[0], sizeof(float));
+            std::memcpy(p+y, &q[1], sizeof(float));
+            std::memcpy(p+z, &q[2], sizeof(float));
+        }
+    }
+    return true;
+}
+
+#endif
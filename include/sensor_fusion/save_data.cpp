@@ -93,15 +93,29 @@ void SaveData::save_pointcloud(const PointCloud2ConstPtr cloud)
     CloudAPtr threshold_cloud(new CloudA);
     
     pcl::fromROSMsg(*cloud, *input_cloud);
-    for(size_t i=0;i<input_cloud->points.size();i++){
-        double distance = sqrt(pow(input_cloud->points[i].x, 2)+ pow(input_cloud->points[i].y, 2) + pow(input_cloud->points[i].z, 2));
-        if(distance < 30)
-            threshold_cloud->points.push_back(input_cloud->points[i]);
+
+    vector<float> times;
+    vector<float> threshold_times;
+    if(deskew_flag) point_times(*cloud, scan_period, times);
+
+    vector<int> indices;
+    range_filter(*input_cloud, 0.0f, 30.0f, indices);
+    copy_points(*input_cloud, indices, *threshold_cloud);
+    if(deskew_flag) copy_values(times, indices, threshold_times);
+
+    // 点ごとの取得時刻の姿勢でglobal座標系に変換してから蓄積する
+    if(deskew_flag){
+        CloudAPtr deskew_cloud(new CloudA);
+        if(!deskew(*threshold_cloud, threshold_times, cloud->header.stamp.toSec(),
+                   pose_buffer, Eigen::Isometry3d::Identity(), *deskew_cloud))
+            return;
+        threshold_cloud = deskew_cloud;
     }
 
     if(count < save_count)
 	{
 		*save_cloud += *threshold_cloud;
+		if(normal_flag) normal_map.add(*threshold_cloud);
 		if(count % 100 == 0) printf("count:%d/%d Cloud_Size:%d\n", count, save_count, int(save_cloud->points.size()));
 	}
 
@@ -139,6 +153,12 @@ void SaveData::transform_listener()
 		ros::Time now = ros::Time::now();
 		global_listener.waitForTransform(global_frame, laser_frame, now, ros::Duration(0.02));
 		global_listener.lookupTransform(global_frame, laser_frame,  now, global_transform);
+
+        tf::Quaternion q = global_transform.getRotation();
+        tf::Vector3 p = global_transform.getOrigin();
+        pose_buffer.push(global_transform.stamp_.toSec(),
+                         Eigen::Quaterniond(q.w(), q.x(), q.y(), q.z()),
+                         Eigen::Vector3d(p.x(), p.y(), p.z()));
 	}
 	catch (tf::TransformException ex){
 		ROS_ERROR("%s",ex.what());
@@ -176,7 +196,7 @@ bool SaveData::check_savepoint()
 void SaveData::save_data()
 {
 	double vel = sqrt( pow(odom.twist.twist.linear.x, 2) + pow(odom.twist.twist.linear.y, 2) );
-    if(arrival && vel < 0.01)
+    if(arrival && (deskew_flag || vel < 0.01))
     {
         // cout<<"Stand by OK!!!!!"<<endl;
 
@@ -187,6 +207,7 @@ void SaveData::save_data()
         else{
 			count = 0;
 			save_cloud->points.clear();
+			normal_map.clear();
 			fail_count++;
             cout<<"   Fail to Save PointCloud!!!!! "<<"FAIL COUNT:"<<fail_count<<endl;;
 		}
@@ -210,6 +231,7 @@ void SaveData::reset()
 	count = 0;
 	distance = 0;
 	save_cloud->points.clear();
+	normal_map.clear();
 	arrival = false;
 	save_flag = false;
 }
@@ -234,22 +256,30 @@ void SaveData::save_process()
 	node.zed2_cinfo = *zed2_cinfo;
 
     cout<<"save process"<<endl;
+
+    // deskew時はglobal座標系で蓄積しているので、保存時点のlaser座標系に戻す
+    CloudAPtr laser_cloud = save_cloud;
+    if(deskew_flag){
+        laser_cloud.reset(new CloudA);
+        pcl_ros::transformPointCloud(*save_cloud, *laser_cloud, global_transform.inverse());
+    }
+
     ColorCloudAPtr zed0_cloud(new ColorCloudA);
     ColorCloudAPtr zed1_cloud(new ColorCloudA);
     ColorCloudAPtr zed2_cloud(new ColorCloudA);
 
     // zed0
-    camera_process(save_cloud, zed0_cinfo, zed0_image,
+    camera_process(laser_cloud, zed0_cinfo, zed0_image,
                    zed0_transform,
                    zed0_frame, laser_frame,
                    zed0_cloud);
     // zed1 
-    camera_process(save_cloud, zed1_cinfo, zed1_image,
+    camera_process(laser_cloud, zed1_cinfo, zed1_image,
             zed1_transform,
             zed1_frame, laser_frame,
             zed1_cloud);
     // zed2                                                                 
-    camera_process(save_cloud, zed2_cinfo, zed2_image,
+    camera_process(laser_cloud, zed2_cinfo, zed2_image,
             zed2_transform,
             zed2_frame, laser_frame,
             zed2_cloud);
@@ -261,13 +291,16 @@ void SaveData::save_process()
     *zed_cloud += *zed1_cloud;
     *zed_cloud += *zed2_cloud;
 
-    // Normal Estimation
-    // pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-    // normal_estimation(zed_cloud, normal_cloud);
-   
     // Transform Pointcloud for global
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr global_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
     global_pointcloud(zed_cloud, global_cloud);
+
+    // Normal Estimation
+    if(normal_flag){
+        pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+        normal_pointcloud(zed_cloud, global_cloud, normal_cloud);
+        saveNormalPCDFile(normal_cloud, node_num);
+    }
     
     // Publish PointCloud
     pub_cloud(global_cloud, global_frame, global_pub);
@@ -410,49 +443,27 @@ void SaveData::normal_estimation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                                  pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& normal_cloud)
 {
 	cout<<"Normal Estimation"<<endl;
-    pcl::NormalEstimation<pcl::PointXYZRGB, pcl::Normal> ne;
-    ne.setInputCloud(cloud);
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZRGB> ());
-    ne.setSearchMethod (tree);
-    pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-    ne.setRadiusSearch (0.2);
-    ne.compute(*normals);
-
-    pcl::PointXYZRGBNormal tmp;
-    for(size_t i=0;i<cloud->points.size();i++)
-    {
-		tmp.x = cloud->points[i].x;
-		tmp.y = cloud->points[i].y;
-		tmp.z = cloud->points[i].z;
-		tmp.r = cloud->points[i].r;
-		tmp.g = cloud->points[i].g;
-		tmp.b = cloud->points[i].b;
-		if(!isnan(normals->points[i].normal_x)){
-			tmp.normal_x = normals->points[i].normal_x;
-		}
-		else{
-			tmp.normal_x = 0.0;
-		}
-		if(!isnan(normals->points[i].normal_y)){
-			tmp.normal_y = normals->points[i].normal_y;
-		}
-		else{
-			tmp.normal_y = 0.0;
-		}
-		if(!isnan(normals->points[i].normal_z)){
-			tmp.normal_z = normals->points[i].normal_z;
-		}
-		else{
-			tmp.normal_z = 0.0;
-		}
-		if(!isnan(normals->points[i].curvature)){
-			tmp.curvature = normals->points[i].curvature;
-		}
-		else{
-			tmp.curvature = 0.0;
-		}
-		normal_cloud->points.push_back(tmp);
-	}
+    NeighborGraph graph;
+    build_neighbor_graph<pcl::PointXYZRGB>(cloud, 0.2f, graph);
+    estimate_normals(*cloud, graph, *normal_cloud);
+}
+
+// 蓄積中に更新したボクセルのモーメントから global座標系の法線付き点群を作る (近傍探索はしない)
+// モーメントは蓄積した座標系 (deskew時はglobal, それ以外はlaser) なので、その座標系の点で引く
+void SaveData::normal_pointcloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
+                                 pcl::PointCloud<pcl::PointXYZRGB>::Ptr global_cloud,
+                                 pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& normal_cloud)
+{
+	cout<<"Normal Estimation : "<<normal_map.size()<<" voxels"<<endl;
+    if(deskew_flag){
+        tf::Vector3 origin = global_transform.getOrigin();
+        normal_map.estimate(*global_cloud, *normal_cloud, Eigen::Vector3f(origin.x(), origin.y(), origin.z()));
+    }
+    else{
+        pcl::PointCloud<pcl::PointXYZRGBNormal> laser_normal_cloud;
+        normal_map.estimate(*cloud, laser_normal_cloud);
+        pcl_ros::transformPointCloudWithNormals(laser_normal_cloud, *normal_cloud, global_transform);
+    }
 }
 
 void SaveData::global_pointcloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud, 
@@ -503,3 +514,14 @@ void SaveData::savePCDFile(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
 	pcl::io::savePCDFile("/home/amsl/PCD/Save/"+file_name+".pcd", *save_cloud);
     printf("Num:%d saved %d\n", count, int(cloud->points.size()));
 }
+
+void SaveData::saveNormalPCDFile(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud,
+                                 int count)
+{
+    cloud->width = cloud->points.size();
+    cloud->height = 1;
+
+    string file_name = normal_path + to_string(count) + ".pcd";
+	pcl::io::savePCDFile(file_name, *cloud);
+    printf("Num:%d saved normal %d\n", count, int(cloud->points.size()));
+}
@@ -35,6 +35,10 @@
 #include <tf/transform_listener.h>
 
 #include <sensor_fusion/Node.h>
+#include <sensor_fusion/deskew.h>
+#include <sensor_fusion/point_kernels.h>
+#include <sensor_fusion/normal_estimation.h>
+#include <sensor_fusion/voxel_normal_map.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -124,6 +128,18 @@ class SaveData{
         CloudAPtr save_cloud;
 		int node_num;
 
+        // deskew
+        // 有効時はスキャンを点ごとにglobal座標系へ補正して蓄積するので、停止を待たずに保存できる
+        bool deskew_flag;
+        double scan_period;
+        PoseBuffer pose_buffer;
+
+        // normal
+        // 有効時は蓄積と同時にボクセルごとのモーメントを更新し、保存時に法線付きの点群も保存する
+        bool normal_flag;
+        string normal_path;
+        VoxelNormalMap normal_map;
+
         // Stop
         Bool stop_flag;
         bool arrival;
@@ -203,6 +219,10 @@ class SaveData{
         void normal_estimation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                                pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& normal_cloud);
 
+        void normal_pointcloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
+                               pcl::PointCloud<pcl::PointXYZRGB>::Ptr global_cloud,
+                               pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr& normal_cloud);
+
         void global_pointcloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
                                pcl::PointCloud<pcl::PointXYZRGB>::Ptr& global_cloud);
 
@@ -212,6 +232,9 @@ class SaveData{
 
 		void savePCDFile(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud, 
                          int count);
+
+		void saveNormalPCDFile(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud,
+                               int count);
  
 };
 
@@ -233,6 +256,13 @@ SaveData::SaveData()
     nh.getParam("zed0_frame", zed0_frame);
     nh.getParam("zed1_frame", zed1_frame);
     nh.getParam("zed2_frame", zed2_frame);
+    nh.param<bool>("deskew", deskew_flag, false);
+    nh.param<double>("scan_period", scan_period, 0.1);
+    nh.param<bool>("normal", normal_flag, false);
+    nh.param<string>("normal_path", normal_path, "/home/amsl/PCD/Save/Normal/");
+    double normal_leaf_size;
+    nh.param<double>("normal_leaf_size", normal_leaf_size, 0.1);
+    normal_map.setLeafSize(normal_leaf_size);
 
     odom_sub = nh.subscribe("/odom", 10, &SaveData::odomCallback, this);
     cloud_sub = nh.subscribe("/cloud", 10, &SaveData::cloudCallback, this);
@@ -0,0 +1,103 @@
+#ifndef _SECTOR_PARTITION_H_
+#define _SECTOR_PARTITION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/index_partition.h>
+#include <sensor_fusion/point_kernels.h>
+
+#include <vector>
+#include <cmath>
+#include <limits>
+
+// 点群を方位角(x-y平面)で num_sectors 個の扇形に分割する
+// セクタ k は [start_angle + k*width, start_angle + (k+1)*width) (width = 2pi/num_sectors)
+//
+// 1. 各点のセクタ番号を分岐なしで並列に計算してlabel配列に保存
+// 2. partition_indices で各セクタのindexリストに振り分ける(出力は入力順)
+// 3. 点群が必要な場合はindexリストの大きさで確保した出力に一度だけコピーする
+//
+// crop_size > 0 のときは |x|,|y| <= crop_size の正方形の外の点を、
+// z の範囲外の点・NaNの点と同様にどのセクタにも入れない
+class SectorPartition{
+    private:
+        int num_sectors;
+        double start_angle;
+        double crop_size;
+        float min_z;
+        float max_z;
+
+        std::vector<int> label;
+
+    public:
+        SectorPartition()
+            : num_sectors(3), start_angle(-M_PI), crop_size(0.0),
+              min_z(-std::numeric_limits<float>::max()), max_z(std::numeric_limits<float>::max()) {}
+
+        SectorPartition(int num_sectors_, double start_angle_ = -M_PI, double crop_size_ = 0.0)
+            : num_sectors(num_sectors_), start_angle(start_angle_), crop_size(crop_size_),
+              min_z(-std::numeric_limits<float>::max()), max_z(std::numeric_limits<float>::max()) {}
+
+        void setNumSectors(int num_sectors_){ num_sectors = num_sectors_; }
+        void setStartAngle(double start_angle_){ start_angle = start_angle_; }
+        void setCropSize(double crop_size_){ crop_size = crop_size_; }
+        void setZLimits(float min_z_, float max_z_){ min_z = min_z_; max_z = max_z_; }
+
+        int getNumSectors() const { return num_sectors; }
+
+        // output[k] : セクタkの点のindex
+        template<typename PointT>
+        void partition(const pcl::PointCloud<PointT>& cloud,
+                       std::vector<std::vector<int> >& output);
+
+        template<typename PointT>
+        void partition(const pcl::PointCloud<PointT>& cloud,
+                       std::vector<pcl::PointCloud<PointT> >& output);
+};
+
+template<typename PointT>
+void SectorPartition::partition(const pcl::PointCloud<PointT>& cloud,
+                                std::vector<std::vector<int> >& output)
+{
+    const int size = int(cloud.points.size());
+    const float scale = float(num_sectors/(2.0*M_PI));
+    const float start = float(start_angle);
+    const float crop = (0.0<crop_size) ? float(crop_size) : std::numeric_limits<float>::infinity();
+    const int last = num_sectors-1;
+
+    label.resize(size);
+
+    // 範囲外・NaNは比較がfalseになるので -1 になる
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const float x = cloud.points[i].x;
+        const float y = cloud.points[i].y;
+        const float z = cloud.points[i].z;
+
+        const bool valid = (std::fabs(x)<=crop) & (std::fabs(y)<=crop) & (min_z<z) & (z<max_z);
+
+        float a = (std::atan2(y, x) - start)*scale;
+        a = valid ? a - num_sectors*std::floor(a/num_sectors) : 0.0f;
+        int s = int(a);
+        s = (s<last) ? s : last;
+
+        label[i] = valid ? s : -1;
+    }
+
+    partition_indices(label, num_sectors, output);
+}
+
+template<typename PointT>
+void SectorPartition::partition(const pcl::PointCloud<PointT>& cloud,
+                                std::vector<pcl::PointCloud<PointT> >& output)
+{
+    std::vector<std::vector<int> > indices;
+    partition(cloud, indices);
+
+    output.resize(num_sectors);
+    for(int k=0;k<num_sectors;k++)
+        copy_points(cloud, indices[k], output[k]);
+}
+
+#endif
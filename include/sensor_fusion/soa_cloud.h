@@ -0,0 +1,296 @@
+#ifndef _SOA_CLOUD_H_
+#define _SOA_CLOUD_H_
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <sensor_fusion/point_kernels.h>
+#include <sensor_fusion/pointcloud2_transform.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#include "Eigen/Core"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// x,y,z を別々の配列で持つ点群 (Structure of Arrays)
+// PointXYZRGBNormal は1点48byteあるが、視錐台カリングや距離フィルタが読むのはx,y,zの12byteだけなので、
+// 座標だけを連続した配列に取り出してから処理すると読み込み量が1/4になり、ループもそのままSIMD化される
+// 結果はindexリストで返すので、元の点群(色や法線)は必要な点だけ後から参照する
+struct SoACloud{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    int size() const { return int(x.size()); }
+    bool empty() const { return x.empty(); }
+
+    void resize(int size)
+    {
+        x.resize(size);
+        y.resize(size);
+        z.resize(size);
+    }
+};
+
+// pcl::PointCloud -> SoACloud
+template<typename PointT>
+void to_soa(const pcl::PointCloud<PointT>& cloud, SoACloud& soa)
+{
+    const int size = int(cloud.points.size());
+    soa.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        soa.x[i] = cloud.points[i].x;
+        soa.y[i] = cloud.points[i].y;
+        soa.z[i] = cloud.points[i].z;
+    }
+}
+
+// indices の点だけを取り出す
+template<typename PointT>
+void to_soa(const pcl::PointCloud<PointT>& cloud, const std::vector<int>& indices, SoACloud& soa)
+{
+    const int size = int(indices.size());
+    soa.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const PointT& p = cloud.points[indices[i]];
+        soa.x[i] = p.x;
+        soa.y[i] = p.y;
+        soa.z[i] = p.z;
+    }
+}
+
+inline void to_soa(const SoACloud& cloud, const std::vector<int>& indices, SoACloud& soa)
+{
+    const int size = int(indices.size());
+    soa.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        soa.x[i] = cloud.x[indices[i]];
+        soa.y[i] = cloud.y[indices[i]];
+        soa.z[i] = cloud.z[indices[i]];
+    }
+}
+
+// PointCloud2 -> SoACloud (pcl::PointCloud を経由しない)
+// FLOAT32 の x,y,z フィールドがなければfalse
+inline bool to_soa(const sensor_msgs::PointCloud2& msg, SoACloud& soa)
+{
+    int ox, oy, oz;
+    if(!find_xyz_offsets(msg, ox, oy, oz)) return false;
+
+    const int width = int(msg.width);
+    const int size = width*int(msg.height);
+    const uint8_t* data = msg.data.data();
+
+    soa.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        const uint8_t* p = data + size_t(i/width)*msg.row_step + size_t(i%width)*msg.point_step;
+        std::memcpy(&soa.x[i], p+ox, sizeof(float));
+        std::memcpy(&soa.y[i], p+oy, sizeof(float));
+        std::memcpy(&soa.z[i], p+oz, sizeof(float));
+    }
+    return true;
+}
+
+// SoACloud -> pcl::PointCloud (x,y,z以外のフィールドは初期値)
+template<typename PointT>
+void from_soa(const SoACloud& soa, const std::vector<int>& indices, pcl::PointCloud<PointT>& cloud)
+{
+    const int size = int(indices.size());
+    cloud.points.resize(size);
+    cloud.width = size;
+    cloud.height = 1;
+    cloud.is_dense = false;
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        PointT p;
+        p.x = soa.x[indices[i]];
+        p.y = soa.y[indices[i]];
+        p.z = soa.z[indices[i]];
+        cloud.points[i] = p;
+    }
+}
+
+template<typename PointT>
+void from_soa(const SoACloud& soa, pcl::PointCloud<PointT>& cloud)
+{
+    const int size = soa.size();
+    cloud.points.resize(size);
+    cloud.width = size;
+    cloud.height = 1;
+    cloud.is_dense = false;
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        PointT p;
+        p.x = soa.x[i];
+        p.y = soa.y[i];
+        p.z = soa.z[i];
+        cloud.points[i] = p;
+    }
+}
+
+// 以下は point_kernels.h の処理の SoACloud 版
+
+// min_range < 距離 < max_range の点を残す (min_range <= 0 なら下限なし)
+inline void range_filter(const SoACloud& cloud,
+                         float min_range, float max_range,
+                         std::vector<int>& indices)
+{
+    const int size = cloud.size();
+    const float lower = (0.0f<min_range) ? min_range*min_range : -1.0f;
+    const float upper = max_range*max_range;
+    const float* x = cloud.x.data();
+    const float* y = cloud.y.data();
+    const float* z = cloud.z.data();
+
+    std::vector<int> mask(size);
+    int* m = mask.data();
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const float d = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+        m[i] = ((lower<d) & (d<upper)) - 1;
+    }
+    mask_to_indices(mask, indices);
+}
+
+// near < 奥行き < far かつ 0 <= u < width, 0 <= v < height の点を残す
+inline void frustum_cull(const SoACloud& cloud,
+                         const Eigen::Matrix<float, 3, 4>& projection,
+                         int width, int height,
+                         float near, float far,
+                         std::vector<int>& indices)
+{
+    const int size = cloud.size();
+    const Eigen::Matrix<float, 3, 4> P = projection;
+    const float w = float(width);
+    const float h = float(height);
+    const float* x = cloud.x.data();
+    const float* y = cloud.y.data();
+    const float* z = cloud.z.data();
+
+    std::vector<int> mask(size);
+    int* m = mask.data();
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const float a = P(0,0)*x[i] + P(0,1)*y[i] + P(0,2)*z[i] + P(0,3);
+        const float b = P(1,0)*x[i] + P(1,1)*y[i] + P(1,2)*z[i] + P(1,3);
+        const float c = P(2,0)*x[i] + P(2,1)*y[i] + P(2,2)*z[i] + P(2,3);
+        m[i] = ((near<c) & (c<far)
+              & (0.0f<=a) & (a<w*c)
+              & (0.0f<=b) & (b<h*c)) - 1;
+    }
+    mask_to_indices(mask, indices);
+}
+
+// pcl::PointCloud の視錐台カリングと SoACloud への取り出しを1パスで行う
+// indices には画角内の点のindex (入力順), soa にはその点の x,y,z が入る
+//
+// 全点を to_soa してから SoA の frustum_cull をすると、全点を2回読んで全点分のmaskも書くことになる
+// 点群を1回しかカリングしないならこちらの方が速い (test/bench_frustum_cull.cpp)
+// 各スレッドが連続した区間の画角内の点を手元に貯め、点数の prefix sum で書き込み位置を決めてコピーする
+template<typename PointT>
+void frustum_cull(const pcl::PointCloud<PointT>& cloud,
+                  const Eigen::Matrix<float, 3, 4>& projection,
+                  int width, int height,
+                  float near, float far,
+                  std::vector<int>& indices,
+                  SoACloud& soa)
+{
+    const int size = int(cloud.points.size());
+    const Eigen::Matrix<float, 3, 4> P = projection;
+    const float w = float(width);
+    const float h = float(height);
+
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    // start[t+1] : スレッドtが残した点の数
+    std::vector<int> start(max_threads+1, 0);
+
+#pragma omp parallel
+    {
+        int tid = 0;
+        int num = 1;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+        num = omp_get_num_threads();
+#endif
+        const int begin = int((long long)size*tid/num);
+        const int end   = int((long long)size*(tid+1)/num);
+
+        SoACloud local;
+        std::vector<int> local_indices;
+        for(int i=begin;i<end;i++){
+            const PointT& p = cloud.points[i];
+            const float a = P(0,0)*p.x + P(0,1)*p.y + P(0,2)*p.z + P(0,3);
+            const float b = P(1,0)*p.x + P(1,1)*p.y + P(1,2)*p.z + P(1,3);
+            const float c = P(2,0)*p.x + P(2,1)*p.y + P(2,2)*p.z + P(2,3);
+            if((near<c) & (c<far)
+             & (0.0f<=a) & (a<w*c)
+             & (0.0f<=b) & (b<h*c)){
+                local_indices.push_back(i);
+                local.x.push_back(p.x);
+                local.y.push_back(p.y);
+                local.z.push_back(p.z);
+            }
+        }
+        start[tid+1] = int(local_indices.size());
+
+#pragma omp barrier
+#pragma omp single
+        {
+            for(int t=0;t<num;t++) start[t+1] += start[t];
+            indices.resize(start[num]);
+            soa.resize(start[num]);
+        }
+
+        std::copy(local_indices.begin(), local_indices.end(), indices.begin() + start[tid]);
+        std::copy(local.x.begin(), local.x.end(), soa.x.begin() + start[tid]);
+        std::copy(local.y.begin(), local.y.end(), soa.y.begin() + start[tid]);
+        std::copy(local.z.begin(), local.z.end(), soa.z.begin() + start[tid]);
+    }
+}
+
+// 全点の画素位置(u, v)とセンサからの距離を求める
+inline void project_points(const SoACloud& cloud,
+                           const Eigen::Matrix<float, 3, 4>& projection,
+                           std::vector<float>& u,
+                           std::vector<float>& v,
+                           std::vector<float>& range)
+{
+    const int size = cloud.size();
+    const Eigen::Matrix<float, 3, 4> P = projection;
+    u.resize(size);
+    v.resize(size);
+    range.resize(size);
+    const float* x = cloud.x.data();
+    const float* y = cloud.y.data();
+    const float* z = cloud.z.data();
+    float* pu = u.data();
+    float* pv = v.data();
+    float* pr = range.data();
+
+#pragma omp parallel for simd schedule(static)
+    for(int i=0;i<size;i++){
+        const float a = P(0,0)*x[i] + P(0,1)*y[i] + P(0,2)*z[i] + P(0,3);
+        const float b = P(1,0)*x[i] + P(1,1)*y[i] + P(1,2)*z[i] + P(1,3);
+        const float c = P(2,0)*x[i] + P(2,1)*y[i] + P(2,2)*z[i] + P(2,3);
+        pu[i] = a/c;
+        pv[i] = b/c;
+        pr[i] = std::sqrt(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    }
+}
+
+#endif
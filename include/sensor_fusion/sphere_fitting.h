@@ -2,6 +2,13 @@
 #include <pcl/point_types.h>
 #include <pcl_ros/point_cloud.h>
 
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "Eigen/Core"
+#include "Eigen/Cholesky"
+
 using namespace std;
 using namespace Eigen;
 
@@ -9,50 +16,301 @@ typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 
-Eigen::Vector4f sphere_fitting(CloudA cloud)
+// 球の当てはめ
+//
+// |p|^2 = 2 c・p + 2 d (中心 c, 半径 r = sqrt(|c|^2 + 2d)) を最小二乗で解く
+// 正規方程式に必要なのは点の1次~3次のモーメントだけなので、点群を1回なめて和を取れば
+// 後から点群を保持しなくてもよく、新しいスキャンが来たら add() で足して solve() し直せる
+//
+// 和は基準点からの差をdoubleで取る (原点から遠い点群で |p|^2 が桁落ちしないように)
+
+struct Sphere{
+    Vector3d center;
+    double radius;
+    bool valid;
+};
+
+class SphereAccumulator{
+    private:
+        bool has_origin;
+        Vector3d origin;
+
+        // n, Σx, Σxx^T(上三角), Σ|x|^2 x, Σ|x|^2
+        double n;
+        double sx, sy, sz;
+        double sxx, sxy, sxz, syy, syz, szz;
+        double qx, qy, qz, q;
+
+    public:
+        SphereAccumulator()
+        {
+            clear();
+        }
+
+        void clear()
+        {
+            has_origin = false;
+            origin.setZero();
+            n = 0.0;
+            sx = sy = sz = 0.0;
+            sxx = sxy = sxz = syy = syz = szz = 0.0;
+            qx = qy = qz = q = 0.0;
+        }
+
+        double size() const { return n; }
+
+        // 差を取る基準点 (最初に add した点群の先頭点が自動で使われる)
+        void setOrigin(const Vector3d& o)
+        {
+            origin = o;
+            has_origin = true;
+        }
+
+        void add(const Vector3d& p)
+        {
+            if(!has_origin) setOrigin(p);
+            const Vector3d d = p - origin;
+            const double s = d.squaredNorm();
+            n += 1.0;
+            sx += d[0]; sy += d[1]; sz += d[2];
+            sxx += d[0]*d[0]; sxy += d[0]*d[1]; sxz += d[0]*d[2];
+            syy += d[1]*d[1]; syz += d[1]*d[2]; szz += d[2]*d[2];
+            qx += s*d[0]; qy += s*d[1]; qz += s*d[2]; q += s;
+        }
+
+        // indices の点 (空なら全点) を1パスで足す
+        template<typename PointT>
+        void add(const pcl::PointCloud<PointT>& cloud, const vector<int>& indices = vector<int>())
+        {
+            const bool all = indices.empty();
+            const int size = all ? int(cloud.points.size()) : int(indices.size());
+            if(size==0) return;
+            if(!has_origin){
+                const PointT& p0 = cloud.points[all ? 0 : indices[0]];
+                setOrigin(Vector3d(p0.x, p0.y, p0.z));
+            }
+            const double ox = origin[0], oy = origin[1], oz = origin[2];
+
+            double _sx = 0, _sy = 0, _sz = 0;
+            double _sxx = 0, _sxy = 0, _sxz = 0, _syy = 0, _syz = 0, _szz = 0;
+            double _qx = 0, _qy = 0, _qz = 0, _q = 0;
+#pragma omp parallel for simd schedule(static) reduction(+:_sx,_sy,_sz,_sxx,_sxy,_sxz,_syy,_syz,_szz,_qx,_qy,_qz,_q)
+            for(int i=0;i<size;i++){
+                const PointT& p = cloud.points[all ? i : indices[i]];
+                const double x = p.x - ox, y = p.y - oy, z = p.z - oz;
+                const double s = x*x + y*y + z*z;
+                _sx += x; _sy += y; _sz += z;
+                _sxx += x*x; _sxy += x*y; _sxz += x*z;
+                _syy += y*y; _syz += y*z; _szz += z*z;
+                _qx += s*x; _qy += s*y; _qz += s*z; _q += s;
+            }
+            n += size;
+            sx += _sx; sy += _sy; sz += _sz;
+            sxx += _sxx; sxy += _sxy; sxz += _sxz; syy += _syy; syz += _syz; szz += _szz;
+            qx += _qx; qy += _qy; qz += _qz; q += _q;
+        }
+
+        // 正規方程式を LDLT で解く (4点未満, または点が同一平面上などで解けなければ valid = false)
+        Sphere solve() const
+        {
+            Sphere sphere;
+            sphere.center = origin;
+            sphere.radius = 0.0;
+            sphere.valid = false;
+            if(n<4.0) return sphere;
+
+            Matrix4d A;
+            A << sxx, sxy, sxz, sx,
+                 sxy, syy, syz, sy,
+                 sxz, syz, szz, sz,
+                 sx,  sy,  sz,  n;
+            A *= 2.0;
+            const Vector4d b(qx, qy, qz, q);
+
+            // 対角が1になるようにスケーリングしてから分解する (S A S w' = S b, w = S w')
+            // A は座標の2次と点数が混ざって対角の桁が揃わないので、そのままではピボットの比で特異かどうか判定できない
+            const Vector4d d = A.diagonal();
+            if(!(0.0<d.minCoeff())) return sphere;
+            const Vector4d scale = d.cwiseSqrt().cwiseInverse();
+            const Matrix4d As = scale.asDiagonal()*A*scale.asDiagonal();
+
+            // 点が同一平面上 (円周上なども含む) だと A は階数落ちし、最小のピボットがほぼ0になる
+            // LDLT はそれでも解を返すので、ピボットの最小/最大の比で判定する
+            const LDLT<Matrix4d> ldlt(As);
+            if(ldlt.info()!=Success) return sphere;
+            const Vector4d pivots = ldlt.vectorD().cwiseAbs();
+            if(!(1e-10*pivots.maxCoeff()<pivots.minCoeff())) return sphere;
+
+            const Vector4d w = scale.cwiseProduct(ldlt.solve(scale.cwiseProduct(b)));
+            const double r2 = w.head<3>().squaredNorm() + 2.0*w[3];
+            if(!std::isfinite(r2) || r2<=0.0) return sphere;
+
+            sphere.center = origin + w.head<3>();
+            sphere.radius = sqrt(r2);
+            sphere.valid = true;
+            return sphere;
+        }
+};
+
+// 点から球面までの距離 |‖p - c‖ - r|
+template<typename PointT>
+inline double sphere_distance(const Sphere& sphere, const PointT& p)
+{
+    return fabs((Vector3d(p.x, p.y, p.z) - sphere.center).norm() - sphere.radius);
+}
+
+// 幾何学的距離の残差 e = ‖p - c‖ - r について J^T J, J^T e と Σe^2 を求める
+template<typename PointT>
+double sphere_normal_equations(const pcl::PointCloud<PointT>& cloud,
+                               const vector<int>& indices,
+                               const Sphere& sphere,
+                               Matrix4d& JtJ,
+                               Vector4d& Jte)
 {
-    Eigen::Matrix4f matrix;
-    matrix = Eigen::Matrix4f::Zero();
-
-    Eigen::Vector4f v;
-    v = Eigen::Vector4f::Zero();
-
-    for(size_t i=0;i<cloud.points.size();i++){
-        matrix(0,0) += 2.0*cloud[i].x*cloud[i].x;
-        matrix(0,1) += 2.0*cloud[i].x*cloud[i].y;
-        matrix(0,2) += 2.0*cloud[i].x*cloud[i].z;
-        matrix(0,3) += 2.0*cloud[i].x;
-
-        matrix(1,0) += 2.0*cloud[i].y*cloud[i].x;
-        matrix(1,1) += 2.0*cloud[i].y*cloud[i].y;
-        matrix(1,2) += 2.0*cloud[i].y*cloud[i].z;
-        matrix(1,3) += 2.0*cloud[i].y;
-
-        matrix(2,0) += 2.0*cloud[i].z*cloud[i].x;
-        matrix(2,1) += 2.0*cloud[i].z*cloud[i].y;
-        matrix(2,2) += 2.0*cloud[i].z*cloud[i].z;
-        matrix(2,3) += 2.0*cloud[i].z;
-
-        matrix(3,0) += 2.0*cloud[i].x;
-        matrix(3,1) += 2.0*cloud[i].y;
-        matrix(3,2) += 2.0*cloud[i].z;
-        matrix(3,3) += 2.0 * 1.0;
-
-        v[0] += cloud[i].x * (cloud[i].x*cloud[i].x+cloud[i].y*cloud[i].y+cloud[i].z*cloud[i].z);
-        v[1] += cloud[i].y * (cloud[i].x*cloud[i].x+cloud[i].y*cloud[i].y+cloud[i].z*cloud[i].z);
-        v[2] += cloud[i].z * (cloud[i].x*cloud[i].x+cloud[i].y*cloud[i].y+cloud[i].z*cloud[i].z);
-        v[3] += cloud[i].x*cloud[i].x+cloud[i].y*cloud[i].y+cloud[i].z*cloud[i].z;
+    const bool all = indices.empty();
+    const int size = all ? int(cloud.points.size()) : int(indices.size());
+    const Vector3d c = sphere.center;
+    const double r = sphere.radius;
+
+    JtJ.setZero();
+    Jte.setZero();
+    double cost = 0.0;
+#pragma omp parallel
+    {
+        Matrix4d local_JtJ = Matrix4d::Zero();
+        Vector4d local_Jte = Vector4d::Zero();
+        double local_cost = 0.0;
+#pragma omp for schedule(static) nowait
+        for(int i=0;i<size;i++){
+            const PointT& p = cloud.points[all ? i : indices[i]];
+            const Vector3d d = Vector3d(p.x, p.y, p.z) - c;
+            const double dist = d.norm();
+            if(dist<=0.0) continue;
+            const double e = dist - r;
+            Vector4d J;
+            J.head<3>() = -d/dist;
+            J[3] = -1.0;
+            local_JtJ.noalias() += J*J.transpose();
+            local_Jte += J*e;
+            local_cost += e*e;
+        }
+#pragma omp critical
+        {
+            JtJ += local_JtJ;
+            Jte += local_Jte;
+            cost += local_cost;
+        }
+    }
+    return cost;
+}
+
+// 幾何学的距離 Σ(‖p - c‖ - r)^2 を Levenberg-Marquardt で最小化する
+// 代数的な解 (solve()) を初期値にすると数回で収束する
+template<typename PointT>
+Sphere refine_sphere(const pcl::PointCloud<PointT>& cloud,
+                     const vector<int>& indices,
+                     Sphere sphere,
+                     int max_iterations = 10)
+{
+    if(!sphere.valid) return sphere;
+
+    Matrix4d JtJ, candidate_JtJ;
+    Vector4d Jte, candidate_Jte;
+    double cost = sphere_normal_equations(cloud, indices, sphere, JtJ, Jte);
+    double lambda = 1e-3;
+
+    for(int iter=0;iter<max_iterations;iter++){
+        Matrix4d H = JtJ;
+        H.diagonal() *= (1.0 + lambda);
+        const Vector4d delta = H.ldlt().solve(-Jte);
+        if(!delta.allFinite() || delta.norm()<1e-9) break;
+
+        Sphere candidate = sphere;
+        candidate.center += delta.head<3>();
+        candidate.radius += delta[3];
+        const double candidate_cost = sphere_normal_equations(cloud, indices, candidate, candidate_JtJ, candidate_Jte);
+
+        // 良くなれば採用してGauss-Newton寄りに, 悪くなれば棄却して勾配法寄りにする
+        if(candidate_cost<cost){
+            sphere = candidate;
+            cost = candidate_cost;
+            JtJ = candidate_JtJ;
+            Jte = candidate_Jte;
+            lambda *= 0.1;
+        }
+        else{
+            lambda *= 10.0;
+        }
+    }
+    return sphere;
+}
+
+// RANSAC で外れ値を除いてから当てはめる
+// 4点から解いた球で距離 threshold 以内の点が最も多いものを選び、その inliers で解き直す
+// 乱数は seed で固定するので結果は再現できる
+template<typename PointT>
+Sphere fit_sphere_ransac(const pcl::PointCloud<PointT>& cloud,
+                         double threshold,
+                         int iterations,
+                         vector<int>& inliers,
+                         unsigned int seed = 1)
+{
+    const int size = int(cloud.points.size());
+    inliers.clear();
+    Sphere best;
+    best.center.setZero();
+    best.radius = 0.0;
+    best.valid = false;
+    if(size<4) return best;
+
+    mt19937 engine(seed);
+    uniform_int_distribution<int> pick(0, size-1);
+    int best_count = 0;
+
+    for(int iter=0;iter<iterations;iter++){
+        SphereAccumulator sample;
+        for(int k=0;k<4;k++){
+            const PointT& p = cloud.points[pick(engine)];
+            sample.add(Vector3d(p.x, p.y, p.z));
+        }
+        const Sphere candidate = sample.solve();
+        if(!candidate.valid) continue;
+
+        int count = 0;
+#pragma omp parallel for simd schedule(static) reduction(+:count)
+        for(int i=0;i<size;i++)
+            count += (sphere_distance(candidate, cloud.points[i])<threshold);
+
+        if(best_count<count){
+            best_count = count;
+            best = candidate;
+        }
     }
-        
-    Eigen::Vector4f vector = matrix.inverse()*v;
+    if(!best.valid) return best;
+
+    for(int i=0;i<size;i++)
+        if(sphere_distance(best, cloud.points[i])<threshold)
+            inliers.push_back(i);
+
+    SphereAccumulator acc;
+    acc.add(cloud, inliers);
+    const Sphere refit = acc.solve();
+    return refit.valid ? refit : best;
+}
+
+// 点群全体に当てはめる
+// 戻り値は従来どおり (c_x, c_y, c_z, d) で、半径は sqrt(|c|^2 + 2d)
+Eigen::Vector4f sphere_fitting(const CloudA& cloud)
+{
+    SphereAccumulator acc;
+    acc.add(cloud);
+    const Sphere sphere = acc.solve();
 
-    // cout << "matrix" << endl <<matrix << endl;
-    // cout << "v" <<  endl << v <<endl;
-    // cout <<"vector" << endl << vector << endl;
+    Eigen::Vector4f vector;
+    vector.head<3>() = sphere.center.cast<float>();
+    vector[3] = float(0.5*(sphere.radius*sphere.radius - sphere.center.squaredNorm()));
 
-    float range = sqrt(vector[0]*vector[0] + vector[1]*vector[1] + vector[2]*vector[2] + 2*vector[3]);
-    
-    printf("x:%.2f y:%.2f z:%.2f r:%.2f\n", vector[0], vector[1], vector[1], range);
+    printf("x:%.2f y:%.2f z:%.2f r:%.2f\n", vector[0], vector[1], vector[2], sphere.radius);
 
     return vector;
 }
@@ -0,0 +1,55 @@
+#ifndef _THRESHOLD_H_
+#define _THRESHOLD_H_
+
+#include <ros/ros.h>
+#include <pcl_ros/point_cloud.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <sensor_fusion/soa_cloud.h>
+
+#include <vector>
+
+// センサからの距離が min_threshold ~ max_threshold の点だけを残す
+// node(paper/threshold.cpp) と nodelet(src/nodelet/sensor_fusion_nodelets.cpp) で共通
+class Threshold{
+	private:
+		ros::Subscriber sub;
+		ros::Publisher pub;
+		double min_threshold;
+		double max_threshold;
+
+	public:
+		Threshold(ros::NodeHandle nh, ros::NodeHandle pnh);
+		void Callback(const sensor_msgs::PointCloud2ConstPtr& msg);
+};
+
+Threshold::Threshold(ros::NodeHandle nh, ros::NodeHandle pnh)
+	: min_threshold(0.0), max_threshold(0.0)
+{
+	pnh.getParam("min_threshold", min_threshold);
+	pnh.getParam("max_threshold", max_threshold);
+
+	sub = nh.subscribe("/cloud", 10, &Threshold::Callback, this);
+	pub = nh.advertise<sensor_msgs::PointCloud2>("/output", 10);
+}
+
+void Threshold::Callback(const sensor_msgs::PointCloud2ConstPtr& msg)
+{
+	// PointCloud2から座標だけを取り出して判定する
+	SoACloud input_cloud;
+	if(!to_soa(*msg, input_cloud)) return;
+
+	std::vector<int> indices;
+	range_filter(input_cloud, float(min_threshold), float(max_threshold), indices);
+
+	pcl::PointCloud<pcl::PointXYZ> threshold_cloud;
+	from_soa(input_cloud, indices, threshold_cloud);
+
+	sensor_msgs::PointCloud2Ptr pc2(new sensor_msgs::PointCloud2);
+	pcl::toROSMsg(threshold_cloud, *pc2);
+	pc2->header.frame_id = msg->header.frame_id;
+	pc2->header.stamp = ros::Time::now();
+	pub.publish(pc2);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef _VOXEL_FILTER_H_
+#define _VOXEL_FILTER_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/centroid.h>
+
+#include <sensor_fusion/index_partition.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#include "Eigen/Core"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// ボクセル座標 (leaf で割って切り捨てた値を int64 で持つので、範囲に上限がない)
+struct VoxelKey{
+    int64_t x, y, z;
+    bool operator==(const VoxelKey& other) const
+    {
+        return x==other.x && y==other.y && z==other.z;
+    }
+};
+
+inline uint64_t hash_voxel_key(const VoxelKey& key)
+{
+    uint64_t h = uint64_t(key.x)*0x9E3779B97F4A7C15ull;
+    h ^= uint64_t(key.y)*0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= uint64_t(key.z)*0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    h ^= h >> 29;
+    return h;
+}
+
+struct VoxelKeyHash{
+    size_t operator()(const VoxelKey& key) const
+    {
+        return size_t(hash_voxel_key(key));
+    }
+};
+
+// 点のボクセル座標 (xyz が有限でなければ false)
+template<typename PointT>
+inline bool voxel_key(const PointT& p, double inv_leaf, VoxelKey& key)
+{
+    if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) return false;
+    key.x = int64_t(std::floor(p.x*inv_leaf));
+    key.y = int64_t(std::floor(p.y*inv_leaf));
+    key.z = int64_t(std::floor(p.z*inv_leaf));
+    return true;
+}
+
+// ハッシュによるボクセルダウンサンプリング (pcl::VoxelGrid の置き換え)
+//
+// pcl::VoxelGrid は点ごとのボクセル番号を int で作って全点をソートするので、
+// 範囲が広く leaf が小さいと番号が溢れて (フィルタせずに警告だけ出す) 使えない
+// ここではボクセル座標を int64 で持ち、次の手順で並列に処理する
+//
+// 1. 点ごとにボクセル座標のハッシュを求め、ハッシュの上位ビットで点をバケットに振り分ける
+//    (partition_indices なので各バケット内の点は入力順)
+// 2. バケットごとに並列にハッシュ表 (線形探索のオープンアドレス法) でボクセルをまとめる
+//    同じボクセルの点は必ず同じバケットに入るので、スレッド間で共有するものはない
+// 3. 各ボクセルの最初の点の位置に出力点を置き、入力順に詰める
+//    出力の並びはバケット数やスレッド数によらず、各ボクセルの最初の点の順になる
+//
+// use_centroid = true  : ボクセル内の点の平均 (pcl::CentroidPoint なので RGB, 法線なども平均される)
+// use_centroid = false : ボクセル内で最初の点をそのまま使う (全フィールドがそのまま残る)
+template<typename PointT>
+class VoxelFilter{
+    private:
+        float leaf_size;
+        bool use_centroid;
+
+        // 呼び出しごとに再確保しないよう保持しておく
+        std::vector<int> label;
+        std::vector<int> id;
+        std::vector<std::vector<int> > buckets;
+        std::vector<std::vector<int> > bucket_first;
+        std::vector<std::vector<VoxelKey> > bucket_keys;
+        std::vector<std::vector<int> > bucket_slots;
+        std::vector<std::vector<PointT, Eigen::aligned_allocator<PointT> > > bucket_points;
+
+    public:
+        VoxelFilter() : leaf_size(0.1f), use_centroid(true) {}
+
+        void setLeafSize(float leaf_size_){ leaf_size = leaf_size_; }
+        void setUseCentroid(bool centroid){ use_centroid = centroid; }
+
+        void filter(const pcl::PointCloud<PointT>& cloud, pcl::PointCloud<PointT>& output);
+};
+
+template<typename PointT>
+void VoxelFilter<PointT>::filter(const pcl::PointCloud<PointT>& cloud, pcl::PointCloud<PointT>& output)
+{
+    const int size = int(cloud.points.size());
+    const double inv_leaf = 1.0/leaf_size;
+
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    // スレッドあたり数個のバケットにして偏りをならす
+    const int num_buckets = 8*max_threads;
+
+    // 1. バケットへの振り分け (無効な点は -1)
+    label.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++){
+        VoxelKey key;
+        label[i] = voxel_key(cloud.points[i], inv_leaf, key) ? int((hash_voxel_key(key) >> 32) % uint64_t(num_buckets)) : -1;
+    }
+    partition_indices(label, num_buckets, buckets);
+
+    // 2. バケットごとにボクセルをまとめる
+    bucket_first.resize(num_buckets);
+    bucket_keys.resize(num_buckets);
+    bucket_slots.resize(num_buckets);
+    bucket_points.resize(num_buckets);
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int b=0;b<num_buckets;b++){
+        const std::vector<int>& points = buckets[b];
+        std::vector<int>& first = bucket_first[b];
+        first.clear();
+
+        // 表の大きさは点数の2倍以上の2の冪 (ボクセル数は点数以下なので埋まりきらない)
+        size_t capacity = 16;
+        while(capacity<2*points.size()) capacity <<= 1;
+        const uint64_t mask = capacity - 1;
+        std::vector<VoxelKey>& keys = bucket_keys[b];
+        std::vector<int>& slots = bucket_slots[b];
+        keys.resize(capacity);
+        slots.assign(capacity, -1);
+
+        std::vector<pcl::CentroidPoint<PointT> > centroids;
+        for(size_t k=0;k<points.size();k++){
+            const int i = points[k];
+            VoxelKey key;
+            voxel_key(cloud.points[i], inv_leaf, key);
+            uint64_t h = hash_voxel_key(key) & mask;
+            while(0<=slots[h] && !(keys[h]==key)) h = (h + 1) & mask;
+            if(slots[h]<0){
+                keys[h] = key;
+                slots[h] = int(first.size());
+                first.push_back(i);
+                if(use_centroid) centroids.push_back(pcl::CentroidPoint<PointT>());
+            }
+            const int slot = slots[h];
+            if(use_centroid) centroids[slot].add(cloud.points[i]);
+        }
+
+        std::vector<PointT, Eigen::aligned_allocator<PointT> >& result = bucket_points[b];
+        result.resize(first.size());
+        for(size_t v=0;v<first.size();v++){
+            if(use_centroid) centroids[v].get(result[v]);
+            else result[v] = cloud.points[first[v]];
+        }
+    }
+
+    // 3. 各ボクセルの最初の点の位置に (バケット, ボクセル) の通し番号を置き、入力順に詰める
+    std::vector<int> offset(num_buckets+1, 0);
+    for(int b=0;b<num_buckets;b++)
+        offset[b+1] = offset[b] + int(bucket_first[b].size());
+    const int num_voxels = offset[num_buckets];
+
+    id.resize(size);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<size;i++) label[i] = -1;
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int b=0;b<num_buckets;b++){
+        for(size_t v=0;v<bucket_first[b].size();v++){
+            label[bucket_first[b][v]] = 0;
+            id[bucket_first[b][v]] = offset[b] + int(v);
+        }
+    }
+    std::vector<std::vector<int> > order;
+    partition_indices(label, 1, order);
+
+    output.header = cloud.header;
+    output.points.resize(num_voxels);
+#pragma omp parallel for schedule(static)
+    for(int k=0;k<num_voxels;k++){
+        const int n = id[order[0][k]];
+        const int b = int(std::upper_bound(offset.begin(), offset.end(), n) - offset.begin()) - 1;
+        output.points[k] = bucket_points[b][n - offset[b]];
+    }
+    output.width = num_voxels;
+    output.height = 1;
+    output.is_dense = true;
+}
+
+#endif
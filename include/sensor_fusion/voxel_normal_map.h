@@ -0,0 +1,157 @@
+#ifndef _VOXEL_NORMAL_MAP_H_
+#define _VOXEL_NORMAL_MAP_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/common/io.h>
+
+#include <sensor_fusion/voxel_filter.h>
+#include <sensor_fusion/normal_estimation.h>
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+
+#include "Eigen/Core"
+
+// 点を蓄積しながら法線を求められるようにするボクセルごとのモーメント
+//
+// add() で点が来るたびに、その点のボクセルの 点数, Σd, Σdd^T (d はボクセル中心からの差, double) を足す
+// 1点あたりハッシュ表の1回の参照と数回の加算だけなので、スキャンを蓄積するループに入れても重くならない
+//
+// 法線は注目点のボクセルと周囲 26 ボクセルのモーメントを足し合わせた共分散から求める
+// (一辺 3*leaf_size の立方体の点から求めることになり、点数によらず27回の参照で済む)
+// 法線, 曲率は normal_estimation.h の normal_from_moments() で求める (compute_normal() と同じ定義)
+class VoxelNormalMap{
+    private:
+        struct Moments{
+            double n;
+            Eigen::Vector3d sum;
+            Eigen::Matrix3d sum_sq;
+        };
+        typedef std::unordered_map<VoxelKey, Moments, VoxelKeyHash> MomentsMap;
+
+        float leaf_size;
+        double inv_leaf;
+        int min_points;
+        MomentsMap voxels;
+
+        Eigen::Vector3d center(const VoxelKey& key) const
+        {
+            return (Eigen::Vector3d(double(key.x), double(key.y), double(key.z)) + Eigen::Vector3d::Constant(0.5))*leaf_size;
+        }
+
+    public:
+        VoxelNormalMap() : leaf_size(0.1f), inv_leaf(10.0), min_points(5) {}
+
+        // 蓄積済みのモーメントはボクセルの大きさに依存するので、変えたら clear() する
+        void setLeafSize(float leaf_size_)
+        {
+            leaf_size = leaf_size_;
+            inv_leaf = 1.0/leaf_size;
+            clear();
+        }
+
+        // 法線を求めるのに必要な周囲 27 ボクセルの点数
+        void setMinPoints(int points){ min_points = points; }
+
+        void clear(){ voxels.clear(); }
+
+        size_t size() const { return voxels.size(); }
+
+        template<typename PointT>
+        void add(const PointT& p)
+        {
+            VoxelKey key;
+            if(!voxel_key(p, inv_leaf, key)) return;
+
+            typename MomentsMap::iterator it = voxels.find(key);
+            if(it==voxels.end()){
+                Moments m;
+                m.n = 0.0;
+                m.sum.setZero();
+                m.sum_sq.setZero();
+                it = voxels.insert(std::make_pair(key, m)).first;
+            }
+            const Eigen::Vector3d d = Eigen::Vector3d(p.x, p.y, p.z) - center(key);
+            Moments& m = it->second;
+            m.n += 1.0;
+            m.sum += d;
+            m.sum_sq.noalias() += d*d.transpose();
+        }
+
+        template<typename PointT>
+        void add(const pcl::PointCloud<PointT>& cloud)
+        {
+            for(size_t i=0;i<cloud.points.size();i++)
+                add(cloud.points[i]);
+        }
+
+        // p の周囲の法線と曲率 (点数が min_points 未満なら false で、法線, 曲率とも0)
+        // 法線は viewpoint 側に向ける
+        // 読むだけなので複数スレッドから同時に呼べる
+        template<typename PointT>
+        bool normal(const PointT& p, const Eigen::Vector3f& viewpoint, Eigen::Vector3f& normal, float& curvature) const
+        {
+            normal.setZero();
+            curvature = 0.0f;
+            VoxelKey key;
+            if(!voxel_key(p, inv_leaf, key)) return false;
+
+            // 各ボクセルのモーメントを注目ボクセルの中心基準に直して足す
+            // d' = d + δ (δ = 隣の中心 - 注目ボクセルの中心) なので
+            // Σd' = Σd + nδ, Σd'd'^T = Σdd^T + Σd δ^T + δ Σd^T + n δδ^T
+            double n = 0.0;
+            Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+            Eigen::Matrix3d sum_sq = Eigen::Matrix3d::Zero();
+            for(int dx=-1;dx<=1;dx++){
+                for(int dy=-1;dy<=1;dy++){
+                    for(int dz=-1;dz<=1;dz++){
+                        VoxelKey neighbor = key;
+                        neighbor.x += dx; neighbor.y += dy; neighbor.z += dz;
+                        typename MomentsMap::const_iterator it = voxels.find(neighbor);
+                        if(it==voxels.end()) continue;
+                        const Moments& m = it->second;
+                        const Eigen::Vector3d delta = Eigen::Vector3d(dx, dy, dz)*leaf_size;
+                        n += m.n;
+                        sum += m.sum + m.n*delta;
+                        sum_sq += m.sum_sq + m.sum*delta.transpose() + delta*m.sum.transpose() + m.n*delta*delta.transpose();
+                    }
+                }
+            }
+            if(n<std::max(min_points, 3)) return false;
+
+            normal_from_moments(n, sum, sum_sq, viewpoint - Eigen::Vector3f(p.x, p.y, p.z), normal, curvature);
+            return true;
+        }
+
+        // cloud の各点の法線を並列に求め、確保済みの出力に書き込む (estimate_normals() と同じ出力)
+        template<typename PointInT, typename PointOutT>
+        void estimate(const pcl::PointCloud<PointInT>& cloud,
+                      pcl::PointCloud<PointOutT>& output,
+                      const Eigen::Vector3f& viewpoint = Eigen::Vector3f::Zero()) const
+        {
+            const int size = int(cloud.points.size());
+            output.header = cloud.header;
+            output.points.resize(size);
+            output.width = size;
+            output.height = 1;
+            output.is_dense = cloud.is_dense;
+
+#pragma omp parallel for schedule(static)
+            for(int i=0;i<size;i++){
+                PointOutT& p = output.points[i];
+                pcl::copyPoint(cloud.points[i], p);
+
+                Eigen::Vector3f n;
+                float curvature;
+                normal(cloud.points[i], viewpoint, n, curvature);
+                p.normal_x = n[0];
+                p.normal_y = n[1];
+                p.normal_z = n[2];
+                p.curvature = curvature;
+            }
+        }
+};
+
+#endif
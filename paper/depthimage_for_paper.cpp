@@ -11,6 +11,10 @@
 #include <image_geometry/pinhole_camera_model.h>
 
 #include <sensor_fusion/NodeInfo.h>
+#include <sensor_fusion/soa_cloud.h>
+#include <sensor_fusion/depth_buffer.h>
+
+#include <limits>
 
 typedef pcl::PointXYZ PointA;
 typedef pcl::PointCloud<PointA> CloudA;
@@ -39,6 +43,8 @@ class DepthImage{
         tf::StampedTransform  camera_transform;
         // cloud
         CloudAPtr map_cloud;
+        // depth image
+        DepthBuffer depth_buffer;
         // node num
         int min_node;
         int max_node;
@@ -60,10 +66,6 @@ class DepthImage{
                                   tf::StampedTransform transform,
                                   string target_frame,
                                   string source_frame);
-        // quiclsort
-        double distance(PointA pt);
-        void pcl_quicksort(CloudA& cloud, int left, int right);
-
         // depthimage
         COLOR GetColor(double v, double vmin, double vmax);
         
@@ -128,67 +130,31 @@ void DepthImage::nodeCallback(const sensor_fusion::NodeInfoConstPtr msg)
     cv::Mat image(cv_img_ptr->image.rows, cv_img_ptr->image.cols, cv_img_ptr->image.type());
     image = cv_bridge::toCvShare(image_msg)->image;
 
-    image_geometry::PinholeCameraModel cam_model;
-    cam_model.fromCameraInfo(cinfo_msg);
-
     // pickup pointcloud(camera area)
-    CloudAPtr reference_cloud(new CloudA);
-    for(CloudA::iterator pt=trans_cloud->points.begin(); pt<trans_cloud->points.end(); pt++)
-    {
-        if ((*pt).x<0) continue;
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
-        if(uv.x>0 && uv.x < image.cols && uv.y > 0 && uv.y < image.rows)
-            reference_cloud->points.push_back(*pt);
-    }
-    std::cout<<"----Image width:"<<image.cols<<" height:"<<image.rows<<std::endl;
-    std::cout<<"----Cloud Size:"<<reference_cloud->points.size()<<std::endl;
+    const Eigen::Matrix<float, 3, 4> projection = laser_to_image_projection(*cinfo_msg);
 
-    // quicksort
-    // 点群をカメラ座標系からの距離が短い順に昇順ソート
-    pcl_quicksort(*reference_cloud, 0, int(reference_cloud->points.size()-1));
+    // カリングと同じパスで画角内の点の座標をSoACloudに取り出す (全点のSoAは作らない)
+    vector<int> indices;
+    SoACloud reference_cloud;
+    frustum_cull(*trans_cloud, projection, image.cols, image.rows, 0.0f, numeric_limits<float>::max(), indices, reference_cloud);
+    std::cout<<"----Image width:"<<image.cols<<" height:"<<image.rows<<std::endl;
+    std::cout<<"----Cloud Size:"<<reference_cloud.size()<<std::endl;
 
     // depthImage
-    double distance[cv_img_ptr->image.rows][cv_img_ptr->image.cols];
-    bool init[cv_img_ptr->image.rows][cv_img_ptr->image.cols];
-    memset(&distance, 0, cv_img_ptr->image.rows*cv_img_ptr->image.cols);
-    memset(&init, false, cv_img_ptr->image.rows*cv_img_ptr->image.cols);
+    // 距離順のソートはせず、Zバッファに各点を1回ずつ書き込んで画素ごとに最も近い点を残す
+    vector<float> u, v, range;
+    project_points(reference_cloud, projection, u, v, range);
 
+    depth_buffer.reset(image.cols, image.rows);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<reference_cloud.size();i++)
+        depth_buffer.splat(u[i], v[i], range[i]);
 
-#pragma omp parallel for
-    for(CloudA::iterator pt=reference_cloud->points.begin(); pt<reference_cloud->points.end(); pt++)
-    {
-        double range = sqrt( pow((*pt).x, 2.0) + pow((*pt).y, 2.0) + pow((*pt).z, 2.0));
-
-        cv::Point3d pt_cv(-(*pt).y, -(*pt).z, (*pt).x);
-        cv::Point2d uv;
-        uv = cam_model.project3dToPixel(pt_cv);
-        
-        for(int i=-1;i<=1;i++){
-            for(int j=-1;j<=1;j++){
-                int x = uv.x + i;
-                int y = uv.y + j;
-                if(0<x && x<image.cols && 0<y && y<image.rows)
-                {
-                    if(!init[y][x])
-                    {
-                        distance[y][x] = range; 
-                        init[y][x] = true;
-                    }   
-                    else{
-                        if(range<distance[y][x])
-                            distance[y][x] = range;
-                    }
-                }
-            }
-        }
-    }
 #pragma omp parallel for
     for(int y=0; y<image.rows; y++){
         for(int x=0; x<image.cols; x++){
-            if(init[y][x]){
-                double range = distance[y][x];
+            if(depth_buffer.valid(x, y)){
+                double range = depth_buffer.depth(x, y);
                 COLOR c = GetColor(int(range/50*255.0), 0, 255);
                 image.at<cv::Vec3b>(y, x)[0] = 255*c.b;
                 image.at<cv::Vec3b>(y, x)[1] = 255*c.g;
@@ -207,49 +173,6 @@ void DepthImage::nodeCallback(const sensor_fusion::NodeInfoConstPtr msg)
     printf("Save Image File (cols:%d rows:%d)\n", image.cols, image.rows);
 }
 
-double DepthImage::distance(PointA point)
-{
-    double dis = sqrt( pow(point.x, 2.0) + pow(point.y, 2.0) + pow(point.z, 2.0));
-    return dis;
-}
-
-void DepthImage::pcl_quicksort(CloudA &cloud, int left, int right)
-{
-    int l_hold, r_hold;
-    double pivot;
-    PointA tmp;
-
-    l_hold = left;
-    r_hold = right;
-    pivot = distance(cloud.points[left]);
-
-    tmp = cloud.points[left];
-
-    while (left < right)
-    {
-        while ((distance(cloud.points[right]) >= pivot) && (left < right))
-            right--;
-        if (left != right)
-        {
-            cloud.points[left] = cloud.points[right];
-            left++;
-        }
-        while ((distance(cloud.points[left]) <= pivot) && (left < right))
-            left++;
-        if (left != right)
-        {
-            cloud.points[right] = cloud.points[left];
-            right--;
-        }
-    }
-    cloud.points[left] = tmp;
-    
-    if(l_hold<left)
-        pcl_quicksort(cloud, l_hold, left-1);
-    if(r_hold > left)
-        pcl_quicksort(cloud, left+1, r_hold);
-}
-
 // start
 void DepthImage::start()
 {
@@ -21,6 +21,7 @@
 #include <cv_bridge/cv_bridge.h>
 
 #include <sensor_fusion/NodeInfo.h>
+#include <sensor_fusion/point_kernels.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -136,11 +137,10 @@ void Saver::saver(const sensor_msgs::PointCloud2ConstPtr msg)
     CloudAPtr threshold_cloud(new CloudA);
 
     pcl::fromROSMsg(*msg, *input_cloud);
-    for(size_t i=0;i<input_cloud->points.size();i++){
-        double distance = sqrt(pow(input_cloud->points[i].x, 2)+ pow(input_cloud->points[i].y, 2) + pow(input_cloud->points[i].z, 2));
-        if(2.0<distance && distance < 30)
-            threshold_cloud->points.push_back(input_cloud->points[i]);
-    }
+
+    vector<int> indices;
+    range_filter(*input_cloud, 2.0f, 30.0f, indices);
+    copy_points(*input_cloud, indices, *threshold_cloud);
 
     if(count < save_num){
 		*save_cloud += *threshold_cloud;
@@ -1,42 +1,5 @@
 #include <ros/ros.h>
-#include <sensor_msgs/PointCloud2.h>
-#include <pcl_ros/point_cloud.h>
-#include <pcl/point_cloud.h>
-#include <pcl/io/pcd_io.h>
-#include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
-#include <iostream>
-
-
-typedef pcl::PointXYZRGB PointA;
-typedef pcl::PointCloud<PointA> CloudA;
-typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
-#include <sensor_fusion/pub_cloud.h>
-
-using namespace std;
-
-ros::Publisher pub_ds_cloud;
-
-double DS_SIZE = 0.03;
-void down_sampling(CloudAPtr cloud, CloudAPtr& cloud_filtered, float size)
-{
-    // Create the filtering object
-    pcl::VoxelGrid<PointA> sor;
-    sor.setInputCloud (cloud);
-    sor.setLeafSize (size, size, size);
-    sor.filter (*cloud_filtered);
-}
-
-void pcCallback(const sensor_msgs::PointCloud2ConstPtr msg)
-{
-    CloudAPtr cloud(new CloudA);
-    pcl::fromROSMsg(*msg, *cloud);
-
-    CloudAPtr ds_cloud(new CloudA);
-    down_sampling(cloud, ds_cloud, DS_SIZE);
-
-    pub_cloud(ds_cloud, msg->header, pub_ds_cloud);
-}
+#include <sensor_fusion/camera_downsample.h>
 
 
 int main(int argc, char**argv)
@@ -45,10 +8,7 @@ int main(int argc, char**argv)
     ros::NodeHandle n;
     ros::NodeHandle nh("~");
 
-    nh.getParam("ds_size", DS_SIZE);
-
-    ros::Subscriber sub = n.subscribe("/cloud", 10, pcCallback);
-    pub_ds_cloud = n.advertise<sensor_msgs::PointCloud2>("/output", 10);
+    CameraDownsample camera_downsample(n, nh);
 
     ros::spin();
 
@@ -12,6 +12,7 @@ division sqlidar pointcloud
 #include<pcl_ros/point_cloud.h>
 #include<pcl/point_cloud.h>
 #include<pcl/point_types.h>
+#include<sensor_fusion/sector_partition.h>
 #define cell_size 0.3
 #define grid_dimentions 140
 
@@ -24,27 +25,17 @@ void pcCallback(const sensor_msgs::PointCloud2ConstPtr& msg)
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
     fromROSMsg(*msg, *cloud);
 
-    pcl::PointCloud<pcl::PointXYZ> pcl_center;
-    pcl::PointCloud<pcl::PointXYZ> pcl_left;
-    pcl::PointCloud<pcl::PointXYZ> pcl_right;
-
     int size = cloud->size();
     printf("size:%d\n",size);
 
-    for(int i=0;i<size;i++)
-    {
-        int x = ((grid_dimentions/2)+cloud->points[i].x/cell_size);
-        int y = ((grid_dimentions/2)+cloud->points[i].y/cell_size);
-
-        if( 0<=x && x<=grid_dimentions && 0<=y && y<=grid_dimentions){
-            if(grid_dimentions/2<=y && sqrt(3)*x+grid_dimentions/2*(1-sqrt(3))<=y) pcl_left.push_back(cloud->points[i]);
-
-            else if(y<=grid_dimentions/2 && y<=(-1)*sqrt(3)*x+(1+sqrt(3))*grid_dimentions/2) pcl_right.push_back(cloud->points[i]);
+    // 方位角 [-180, -60) : right, [-60, 60) : center, [60, 180] : left
+    SectorPartition sector_partition(3, -M_PI, grid_dimentions/2*cell_size);
+    std::vector<pcl::PointCloud<pcl::PointXYZ> > sectors;
+    sector_partition.partition(*cloud, sectors);
 
-            else pcl_center.push_back(cloud->points[i]);
-            
-        }
-    }
+    const pcl::PointCloud<pcl::PointXYZ>& pcl_center = sectors[1];
+    const pcl::PointCloud<pcl::PointXYZ>& pcl_left   = sectors[2];
+    const pcl::PointCloud<pcl::PointXYZ>& pcl_right  = sectors[0];
 
     sensor_msgs::PointCloud2 pc_center;
     pcl::toROSMsg(pcl_center, pc_center);
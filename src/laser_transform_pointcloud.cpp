@@ -13,67 +13,17 @@ author : Yudai Sadakuni
 */
 
 #include <ros/ros.h>
-#include "ros/package.h"
-#include <sensor_msgs/PointCloud.h>
-#include <sensor_msgs/PointCloud2.h>
-#include <sensor_msgs/point_cloud_conversion.h>
-#include <tf/tf.h>
-#include <tf/transform_listener.h>
-
-
-using namespace std;
-
-class PointCloudTransform{
-	private:
-		ros::NodeHandle nh;
-		ros::NodeHandle nhPrivate;
-		tf::TransformListener listener;
-		tf::StampedTransform transform;
-		ros::Publisher pub;
-		ros::Subscriber sub;
-		ros::Time t;
-		sensor_msgs::PointCloud pc_;
-		string target_frame = "centerlaser";
-
-	public:
-		PointCloudTransform();
-		void Callback(const sensor_msgs::PointCloud2ConstPtr& msg);
-};
-
-PointCloudTransform::PointCloudTransform()
-	: nhPrivate("~")
-{
-    nhPrivate.getParam("target_frame", target_frame);
-	sub = nh.subscribe("/cloud", 10, &PointCloudTransform::Callback, this);
-	pub = nh.advertise<sensor_msgs::PointCloud2>("/cloud/tf", 10);
-}
-
-void PointCloudTransform::Callback(const sensor_msgs::PointCloud2ConstPtr &msg){
-	sensor_msgs::convertPointCloud2ToPointCloud(*msg, pc_);
-	t = msg->header.stamp;
-	string source_frame = msg->header.frame_id;
-
-	sensor_msgs::PointCloud pc_trans;
-	sensor_msgs::PointCloud2 pc2_trans;
-
-	try{
-		listener.waitForTransform(target_frame.c_str(), source_frame.c_str(), t, ros::Duration(1.0));
-		listener.transformPointCloud(target_frame.c_str(), t, pc_, source_frame.c_str(), pc_trans);
-		sensor_msgs::convertPointCloudToPointCloud2(pc_trans, pc2_trans);
-		pub.publish(pc2_trans);
-	}catch (tf::TransformException& ex) {
-		ROS_WARN("[draw_frames] TF exception:\n%s", ex.what());
-	}
-}
+#include <sensor_fusion/laser_transform_pointcloud.h>
 
 
 int main(int argc, char** argv)
 {
     ros::init(argc, argv, "laser_tramsform_pointcloud");
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
 	
-	PointCloudTransform transform;
+	PointCloudTransform transform(nh, pnh);
 	ros::spin();
 
     return 0;
 }
-
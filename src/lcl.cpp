@@ -27,6 +27,10 @@ author : Yudai Sadakuni
 #include "Eigen/Dense"
 #include "Eigen/LU"
 
+#include <sensor_fusion/local_map.h>
+#include <sensor_fusion/deskew.h>
+#include <sensor_fusion/point_kernels.h>
+
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -37,8 +41,8 @@ typedef pcl::PointXYZI PointA;
 typedef pcl::PointCloud<PointA> CloudA;
 typedef pcl::PointCloud<PointA>::Ptr CloudAPtr;
 
-CloudAPtr save_pc_ (new CloudA);
-CloudAPtr old_pc_ (new CloudA);
+LocalMap<PointA> local_map_;
+PoseBuffer pose_buffer_;
 
 nav_msgs::Odometry odom_;
 nav_msgs::Odometry init_odom_;
@@ -49,16 +53,18 @@ ros::Publisher pub;
 
 ros::Publisher pub_sq_time;
 
-Eigen::Matrix4f transform_matrix;
-Eigen::Matrix4f inverse_transform_matrix;
+Eigen::Matrix4f transform_matrix = Eigen::Matrix4f::Identity();
 
-int count_ = 0;
 int skip = 0;
 int save_num = 0;
 int skip_count = 10;
 
 bool init_lcl_flag = false;
 
+// 走行中のスキャンを点ごとの姿勢で補正する
+bool deskew_flag = false;
+double scan_period = 0.1;
+
 float z_threshold = 30.0;
 
 Eigen::Matrix4f create_matrix(nav_msgs::Odometry odom_now, float reflect){
@@ -85,6 +91,11 @@ void lcl_callback(nav_msgs::Odometry msg){
     }
     odom_ = msg;
     transform_matrix = create_matrix(odom_, 1.0);
+
+    pose_buffer_.push(msg.header.stamp.toSec(),
+                      Eigen::Quaterniond(msg.pose.pose.orientation.w, msg.pose.pose.orientation.x,
+                                         msg.pose.pose.orientation.y, msg.pose.pose.orientation.z),
+                      Eigen::Vector3d(msg.pose.pose.position.x, msg.pose.pose.position.y, msg.pose.pose.position.z));
 }
 
 void pc_callback(const sensor_msgs::PointCloud2ConstPtr msg)
@@ -95,41 +106,36 @@ void pc_callback(const sensor_msgs::PointCloud2ConstPtr msg)
 
     cout<<"single_pc_ : " <<single_pc_->points.size()<<endl;
 
-    CloudAPtr output_pc (new CloudA);
-    pcl::transformPointCloud(*single_pc_, *output_pc, transform_matrix);
-
-    CloudAPtr output_pc_after (new CloudA);
-
-    for(size_t i=0;i<single_pc_->points.size();i++){
-        double distance = sqrt(pow(single_pc_->points[i].x, 2)+
-                pow(single_pc_->points[i].y, 2)+
-                pow(single_pc_->points[i].z, 2));
-        if(distance < 30){
-            //if(single_pc_->points[i].z <= z_threshold){
-            PointA temp;
-            output_pc_after->points.push_back(output_pc->points[i]);
+    // 各点を header.stamp 時の姿勢の座標系に補正し、その姿勢をスキャンの姿勢とする
+    Eigen::Matrix4f scan_pose = transform_matrix;
+    Eigen::Isometry3d reference;
+    if(deskew_flag && pose_buffer_.interpolate(msg->header.stamp.toSec(), reference)){
+        vector<float> times;
+        point_times(*msg, scan_period, times);
+
+        CloudAPtr deskew_pc_(new CloudA);
+        if(deskew(*single_pc_, times, msg->header.stamp.toSec(), pose_buffer_, reference, *deskew_pc_)){
+            single_pc_ = deskew_pc_;
+            scan_pose = reference.matrix().cast<float>();
         }
     }
 
+    // 範囲内の点だけをセンサ座標系のまま保存し、取得時の姿勢を一緒に持たせる
+    // 現在の姿勢への動き補償は publish 時に LocalMap がスキャンごとに1回だけ行う
+    vector<int> indices;
+    range_filter(*single_pc_, 0.0f, z_threshold, indices);
+
     CloudAPtr output_save_pc (new CloudA);
-    Eigen::Matrix4f inverse_transform_matrix = transform_matrix.inverse();
-    pcl::transformPointCloud(*output_pc_after, *output_save_pc, inverse_transform_matrix);
-
-
-    if(count_ < save_num){
-        *save_pc_ += *output_save_pc;
-        old_pc_ = output_save_pc;
-        count_++;
-    }else{
-        int old_pc_size = (int)old_pc_->points.size();
-        save_pc_->points.erase(save_pc_->points.begin(), save_pc_->points.begin()+old_pc_size);
-        *save_pc_ += *output_save_pc;
-        old_pc_ = output_save_pc;
-    }
+    copy_points(*single_pc_, indices, *output_save_pc);
+
+    local_map_.push(output_save_pc, scan_pose);
     
     if(skip%skip_count == 0){
+        CloudA save_pc_;
+        local_map_.concatenate(save_pc_, transform_matrix);
+
         sensor_msgs::PointCloud2 pc_;
-        pcl::toROSMsg(*save_pc_, pc_);
+        pcl::toROSMsg(save_pc_, pc_);
         pc_.header.stamp = ros::Time::now();
         pc_.header.frame_id = msg->header.frame_id;
         pub.publish(pc_);
@@ -146,6 +152,11 @@ int main(int argc, char** argv)
     ros::NodeHandle n;
     n.getParam("lcl/save_num", save_num);
     n.getParam("lcl/skip_num", skip_count);
+    n.getParam("lcl/deskew", deskew_flag);
+    n.getParam("lcl/scan_period", scan_period);
+    // コールバック時にはスキャン中の姿勢がまだ届いていないので、スキャン1回分と odometry の遅れの分だけ外挿する
+    pose_buffer_.setMaxExtrapolation(2.0*scan_period);
+    local_map_.setSize(save_num);
     // ros::Rate rate(20);
 
     ros::Subscriber sub_pc = n.subscribe("/cloud/tf", 30, pc_callback);
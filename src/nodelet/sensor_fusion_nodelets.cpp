@@ -0,0 +1,86 @@
+/*
+
+nodelet version of the SQ-LiDAR front-end
+
+同じnodelet managerに載せると、点群はshared_ptrのままプロセス内で受け渡され
+シリアライズ/デシリアライズが発生しない
+
+author : Yudai Sadakuni
+
+*/
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+
+#include <sensor_fusion/division.h>
+#include <sensor_fusion/integration.h>
+#include <sensor_fusion/laser_transform_pointcloud.h>
+#include <sensor_fusion/camera_downsample.h>
+#include <sensor_fusion/threshold.h>
+
+namespace sensor_fusion
+{
+
+class DivisionNodelet : public nodelet::Nodelet
+{
+    private:
+        boost::shared_ptr<Division> impl;
+
+        virtual void onInit()
+        {
+            impl.reset(new Division(getNodeHandle(), getPrivateNodeHandle()));
+        }
+};
+
+class IntegrationNodelet : public nodelet::Nodelet
+{
+    private:
+        boost::shared_ptr<Integration> impl;
+
+        virtual void onInit()
+        {
+            impl.reset(new Integration(getNodeHandle(), getPrivateNodeHandle()));
+        }
+};
+
+class LaserTransformPointCloudNodelet : public nodelet::Nodelet
+{
+    private:
+        boost::shared_ptr<PointCloudTransform> impl;
+
+        virtual void onInit()
+        {
+            impl.reset(new PointCloudTransform(getNodeHandle(), getPrivateNodeHandle()));
+        }
+};
+
+class CameraDownsampleNodelet : public nodelet::Nodelet
+{
+    private:
+        boost::shared_ptr<CameraDownsample> impl;
+
+        virtual void onInit()
+        {
+            impl.reset(new CameraDownsample(getNodeHandle(), getPrivateNodeHandle()));
+        }
+};
+
+class ThresholdNodelet : public nodelet::Nodelet
+{
+    private:
+        boost::shared_ptr<Threshold> impl;
+
+        virtual void onInit()
+        {
+            impl.reset(new Threshold(getNodeHandle(), getPrivateNodeHandle()));
+        }
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(sensor_fusion::DivisionNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(sensor_fusion::IntegrationNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(sensor_fusion::LaserTransformPointCloudNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(sensor_fusion::CameraDownsampleNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(sensor_fusion::ThresholdNodelet, nodelet::Nodelet)
@@ -0,0 +1,111 @@
+/*
+benchmark for frustum culling in depthimage_creater
+
+画角内の点を取り出して SoACloud にするまでを3通りで比べる
+    soa   : 全点を to_soa で詰め直してから SoA の frustum_cull, 画角内の点を to_soa
+    aos   : PointXYZRGBNormal のまま frustum_cull して、画角内の点だけ to_soa
+    fused : PointXYZRGBNormal のまま frustum_cull し、同じパスで画角内の点を SoACloud に書く
+
+soa は全点を2回読み、全点分の mask も書いて mask_to_indices で詰めるので、1回しか使わない点群では fused が速い
+
+build:
+    catkin_make -DBUILD_BENCHMARKS=ON
+usage:
+    OMP_NUM_THREADS=4 rosrun sensor_fusion bench_frustum_cull [points] [iterations]
+
+*/
+
+#include <sensor_fusion/soa_cloud.h>
+#include <sensor_fusion/point_kernels.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+typedef pcl::PointXYZRGBNormal PointA;
+
+double elapsed_ms(const chrono::steady_clock::time_point& start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    const int size       = (1<argc) ? atoi(argv[1]) : 2000000;
+    const int iterations = (2<argc) ? atoi(argv[2]) : 20;
+
+    // laser座標系で周囲 50m に散らばった点 (前方のカメラに入るのは一部)
+    pcl::PointCloud<PointA> cloud;
+    cloud.points.resize(size);
+    mt19937 rng(0);
+    uniform_real_distribution<float> xy(-50.0f, 50.0f);
+    uniform_real_distribution<float> z(-2.0f, 3.0f);
+    for(int i=0;i<size;i++){
+        cloud.points[i].x = xy(rng);
+        cloud.points[i].y = xy(rng);
+        cloud.points[i].z = z(rng);
+    }
+    cloud.width = size;
+    cloud.height = 1;
+
+    // ZED (672x376) 相当の P
+    Eigen::Matrix<float, 3, 4> P = Eigen::Matrix<float, 3, 4>::Zero();
+    P(0,0) = 350.0f; P(0,2) = 336.0f;
+    P(1,1) = 350.0f; P(1,2) = 188.0f;
+    P(2,2) = 1.0f;
+    Eigen::Matrix4f axes = Eigen::Matrix4f::Zero();
+    axes(0, 1) = -1.0f;
+    axes(1, 2) = -1.0f;
+    axes(2, 0) =  1.0f;
+    axes(3, 3) =  1.0f;
+    const Eigen::Matrix<float, 3, 4> projection = P*axes;
+    const int width = 672;
+    const int height = 376;
+    const float far = numeric_limits<float>::max();
+
+    vector<int> indices;
+    SoACloud all;
+    SoACloud reference;
+
+    double soa_ms = 0.0;
+    double aos_ms = 0.0;
+    double fused_ms = 0.0;
+    int soa_points = 0;
+    int aos_points = 0;
+    int fused_points = 0;
+    for(int it=0;it<iterations;it++){
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        to_soa(cloud, all);
+        frustum_cull(all, projection, width, height, 0.0f, far, indices);
+        to_soa(all, indices, reference);
+        soa_ms += elapsed_ms(start);
+        soa_points = reference.size();
+
+        start = chrono::steady_clock::now();
+        frustum_cull(cloud, projection, width, height, 0.0f, far, indices);
+        to_soa(cloud, indices, reference);
+        aos_ms += elapsed_ms(start);
+        aos_points = reference.size();
+
+        start = chrono::steady_clock::now();
+        frustum_cull(cloud, projection, width, height, 0.0f, far, indices, reference);
+        fused_ms += elapsed_ms(start);
+        fused_points = reference.size();
+    }
+
+    cout<<"points    : "<<size<<" ("<<aos_points<<" in view)"<<endl;
+    cout<<"soa       : "<<soa_ms/iterations<<" ms"<<endl;
+    cout<<"aos       : "<<aos_ms/iterations<<" ms"<<endl;
+    cout<<"fused     : "<<fused_ms/iterations<<" ms"<<endl;
+    if(soa_points!=aos_points || soa_points!=fused_points)
+        cout<<"mismatch  : "<<soa_points<<", "<<aos_points<<", "<<fused_points<<endl;
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+check for the hypothesis sampling in MultiPlaneSegmentation
+
+1. 仮説ごとに選ぶ点が点群全体に散らばっているかを調べる
+   (seed と仮説番号の線形合同で作った乱数では、最初の1点が一部のindexに固まっていた)
+
+   10000点, 1000仮説の最初の1点について
+       - 異なるindexの数 (一様なら約950)
+       - 10等分した区間ごとの数 (一様なら約100)
+   を表示し、どちらかが大きく外れたら NG
+
+2. 2枚の平面とノイズの点群を1スレッドと3スレッドで segment() し、
+   平面の係数と inlier が完全に一致しなければ NG
+
+どちらかが NG なら 1 を返す
+
+build:
+    catkin_make -DBUILD_BENCHMARKS=ON
+usage:
+    rosrun sensor_fusion check_plane_sampling
+
+*/
+
+#include <sensor_fusion/plane_segmentation.h>
+
+#include <iostream>
+#include <vector>
+#include <set>
+#include <random>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+bool check_sampling()
+{
+    const int size = 10000;
+    const int iterations = 1000;
+    const int bins = 10;
+
+    MultiPlaneSegmentation seg;
+    bool ok = true;
+    for(int k=0;k<3;k++){
+        set<int> distinct;
+        vector<int> histogram(bins, 0);
+        for(int it=0;it<iterations;it++){
+            int sample[3];
+            seg.sampleIndices(k, it, size, sample);
+            distinct.insert(sample[0]);
+            histogram[sample[0]*bins/size]++;
+        }
+
+        cout<<"plane "<<k<<" : distinct "<<distinct.size()<<" / "<<iterations<<", bins";
+        for(int b=0;b<bins;b++) cout<<" "<<histogram[b];
+        cout<<endl;
+
+        if(int(distinct.size())<900) ok = false;
+        for(int b=0;b<bins;b++)
+            if(histogram[b]<60 || 140<histogram[b]) ok = false;
+    }
+    return ok;
+}
+
+bool check_threads()
+{
+    // z = 0 の床 4000点, x = 2 の壁 2000点, 箱の中のノイズ 500点
+    CloudA cloud;
+    mt19937 rng(0);
+    uniform_real_distribution<float> u(-1.0f, 1.0f);
+    for(int i=0;i<4000;i++){
+        PointA p;
+        p.x = 2.0f*u(rng); p.y = 2.0f*u(rng); p.z = 0.005f*u(rng);
+        cloud.points.push_back(p);
+    }
+    for(int i=0;i<2000;i++){
+        PointA p;
+        p.x = 2.0f + 0.005f*u(rng); p.y = 2.0f*u(rng); p.z = 1.0f + u(rng);
+        cloud.points.push_back(p);
+    }
+    for(int i=0;i<500;i++){
+        PointA p;
+        p.x = 2.0f*u(rng); p.y = 2.0f*u(rng); p.z = 1.0f + u(rng);
+        cloud.points.push_back(p);
+    }
+
+    MultiPlaneSegmentation seg;
+    seg.setDistanceThreshold(0.02f);
+    seg.setMaxPlanes(2);
+    seg.setMinInliers(100);
+
+    vector<PlaneModel> planes[2];
+    const int threads[2] = {1, 3};
+    for(int t=0;t<2;t++){
+#ifdef _OPENMP
+        omp_set_num_threads(threads[t]);
+#endif
+        seg.segment(cloud, planes[t]);
+    }
+
+    bool ok = planes[0].size()==2 && planes[0].size()==planes[1].size();
+    for(size_t k=0;k<planes[0].size() && k<planes[1].size();k++){
+        cout<<"plane "<<k<<" : "<<planes[0][k].coefficients.transpose()
+            <<" inliers "<<planes[0][k].inliers.size()<<" / "<<planes[1][k].inliers.size()<<endl;
+        if(planes[0][k].coefficients!=planes[1][k].coefficients) ok = false;
+        if(planes[0][k].inliers!=planes[1][k].inliers) ok = false;
+    }
+    return ok;
+}
+
+int main()
+{
+    const bool sampling = check_sampling();
+    cout<<"sampling : "<<(sampling ? "OK" : "NG")<<endl;
+    const bool threads = check_threads();
+    cout<<"1 vs 3 threads : "<<(threads ? "OK" : "NG")<<endl;
+    return (sampling && threads) ? 0 : 1;
+}